@@ -1,7 +1,9 @@
-#include <SDL/SDL.h>
 #include <vector>
+#include <cstring>
 #include <algorithm>
 #include <linealg.h>
+#include <vertexstream.h>
+#include <display.h>
 #include <ilu.h>
 #include "clipplane.h"
 #include "rasterizer.h"
@@ -11,16 +13,16 @@
 
 int main(int argc, char* argv[])
 {
-    (void)argc;
-    (void)argv;
-	
-    const int width = 640;
-    const int height = 480;
-    const int depth = 32;
-    bool running = true;
-    SDL_Event event;
-    std::vector<Vector4f> vertexData; /* Our original mesh */
-    std::vector<Vector4f> tcoordData; /* Our original mesh */
+    DisplayOptions options(640, 480);
+    if(!ParseDisplayOptions(argc, argv, options))
+        return 1;
+    const int width = options.width;
+    const int height = options.height;
+    bool bilinear = false;
+    IndexedMesh mesh;                 /* Our original mesh */
+    std::vector<Vector4f> tcoordData; /* Texture coordinate of every triangle corner */
+    VertexStream vertexStream;  /* Its unique vertices, SoA for the batch transform */
+    VertexStream clipStream;    /* Transformed vertices */
     std::vector<Vector4f> workingCopyVertex;  /* Intermediate working copy */ 
     std::vector<Vector4f> workingCopyTCoord;  /* Intermediate working copy */ 
     std::vector<Vector4i> vertexDataFP;    /* Final copy, fixedpoint */
@@ -29,42 +31,38 @@ int main(int argc, char* argv[])
 
 	ilInit();
 	iluInit();
-    SDL_Init(SDL_INIT_VIDEO);
-    SDL_Surface* screen = SDL_SetVideoMode(width, height, depth, SDL_DOUBLEBUF | SDL_SWSURFACE);
-    SDL_WM_SetCaption("MechCore.net Projection Example", NULL);
+    Display* display = OpenDisplay(options, "MechCore.net Affine Texture Mapping Example");
     
-    makeMeshPlane(vertexData, tcoordData, 1.0f);
-    const Texture* texture = ReadPNG("texture0.png");
+    makeMeshPlane(mesh, 1.0f);
+    expandIndexedMesh(mesh, workingCopyVertex, tcoordData);
+    toVertexStream(mesh.vertices, vertexStream);
+    /* Texels go to the screen as they are, so load them in its byte order */
+    const Texture* texture = ReadPNG("texture0.png", display->bgra() ? TEXTURE_BGRA8_PREMULTIPLIED : TEXTURE_RGBA8_PREMULTIPLIED);
     if(!texture){
 	printf("Couldn't load one or more texture maps.\n \
 Make sure you have copied the data from the source directory to the binary directory, or CWD.\n");
     }
     BindTexture(texture);
 
-    while(running){
-        while(SDL_PollEvent(&event)){
-            switch(event.type)
-            {
-            case SDL_KEYDOWN:
-		if(event.key.keysym.sym == SDLK_ESCAPE){
-		    running = false;
-		}
-		break;
-            case SDL_QUIT:
-                running = false;
-                break;
+    while(display->running()){
+        int key;
+        while((key = display->pollKey()) != DISPLAY_KEY_NONE){
+            if(key == DISPLAY_KEY_ESCAPE)
+                display->close();
+            /* F switches between nearest and bilinear filtering */
+            if(key == 'f'){
+                bilinear = !bilinear;
+                SetTextureFilter(bilinear ? TEXTURE_BILINEAR : TEXTURE_NEAREST);
+                printf("Bilinear filtering %s\n", bilinear ? "on" : "off");
             }
         }
 
-        float time_elapsed = (float)SDL_GetTicks() * 0.001f;
-        /* We need a new working copy every frame */
-        workingCopyVertex.resize(vertexData.size());
+        float time_elapsed = (float)display->ticks() * 0.001f;
+        /* We need a new working copy every frame. The vertices get theirs from the transform */
 	workingCopyTCoord.resize(tcoordData.size());
-	/* Copy our original data into the working copies */
-        std::copy(vertexData.begin(), vertexData.end(), workingCopyVertex.begin());
         std::copy(tcoordData.begin(), tcoordData.end(), workingCopyTCoord.begin());
 	/* Make sure our buffers are of the same size */
-	ASSERT(workingCopyVertex.size() == workingCopyTCoord.size());
+	ASSERT(mesh.indexCount() == tcoordData.size());
 
         /* world matrix transform */
         Matrix4f worldMatrix = translate(Vector4f(0.0f, 0.0f, -2.25f, 1.0f)) *
@@ -73,18 +71,12 @@ Make sure you have copied the data from the source directory to the binary direc
 	    rotateY(45.0f *   time_elapsed);
 	
 	/* perspective function is in linealg.h under /include */
-        Matrix4f clipMatrix = perspective(90.0f, 4.0f/3.0f, 0.01f, 20.0f);
+        Matrix4f clipMatrix = perspective(90.0f, (float)width/height, 0.01f, 20.0f);
 	Matrix4f worldClipMatrix = clipMatrix * worldMatrix;
 	
-        /* Transform our points */
-	for(unsigned int i=0; i<workingCopyVertex.size(); i+=3){
-	    Vector4f& p1 = workingCopyVertex[i];
-	    Vector4f& p2 = workingCopyVertex[i+1];
-	    Vector4f& p3 = workingCopyVertex[i+2];
-            p1 = worldClipMatrix * p1;
-	    p2 = worldClipMatrix * p2;
-	    p3 = worldClipMatrix * p3;
-	}
+        /* Transform our unique points, several at a time, and expand the triangles for the clipper */
+        transformStream(worldClipMatrix, vertexStream, clipStream);
+        gatherTriangles(clipStream, mesh, workingCopyVertex);
 
 	/* Clip against the six frustum planes */
 	clip_triangle(workingCopyVertex, workingCopyTCoord, Vector4f(-1.0f,  0.0f, 0.0f, 1.0f));
@@ -127,17 +119,18 @@ Make sure you have copied the data from the source directory to the binary direc
 				       );
 	}
 	
-        unsigned int* pixels = static_cast<unsigned int*>(screen->pixels);
+        unsigned int pitch;
+        unsigned int* pixels = display->lock(pitch);
 
         /* clear the screen to black */
-        memset(pixels, 0, sizeof(Uint32) * width * height);
+        memset(pixels, 0, sizeof(unsigned int) * pitch * height);
 	/* Split the  triangles so that they start and end on horisontal edges*/
 	TriangleSplit(vertexDataFP, tcoordDataFP);
 	/* Draw the triangles */
-	DrawTriangle(vertexDataFP, tcoordDataFP, pixels, width, height);
+	DrawTriangle(vertexDataFP, tcoordDataFP, pixels, width, height, pitch);
 
-	SDL_Flip(screen);
+        display->present();
     }    
-    SDL_Quit();
+    delete display;
     return 0;
 }
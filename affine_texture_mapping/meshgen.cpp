@@ -152,12 +152,12 @@ void makeMeshCube(std::vector<Vector4f>& vertexData,
     vertexData.push_back(v1);
     vertexData.push_back(v5);
     /* Back */
-    vertexData.push_back(v0);
-    vertexData.push_back(v1);
-    vertexData.push_back(v4);
-    vertexData.push_back(v4);
     vertexData.push_back(v1);
+    vertexData.push_back(v0);
     vertexData.push_back(v5);
+    vertexData.push_back(v5);
+    vertexData.push_back(v0);
+    vertexData.push_back(v4);
     /* Front */
     vertexData.push_back(v2);
     vertexData.push_back(v3);
@@ -175,3 +175,33 @@ void makeMeshCube(std::vector<Vector4f>& vertexData,
 	tcoordData.push_back(t3);
     }
 }
+
+/* The indexed versions generate the triangle list as above and merge
+   the corners it repeats */
+void makeMeshSphere(IndexedMesh& mesh, float radius)
+{
+    std::vector<Vector4f> vertexData, tcoordData;
+    makeMeshSphere(vertexData, radius);
+    buildIndexedMesh(vertexData, tcoordData, mesh);
+}
+
+void makeMeshCircle(IndexedMesh& mesh, float radius)
+{
+    std::vector<Vector4f> vertexData, tcoordData;
+    makeMeshCircle(vertexData, radius);
+    buildIndexedMesh(vertexData, tcoordData, mesh);
+}
+
+void makeMeshPlane(IndexedMesh& mesh, float size)
+{
+    std::vector<Vector4f> vertexData, tcoordData;
+    makeMeshPlane(vertexData, tcoordData, size);
+    buildIndexedMesh(vertexData, tcoordData, mesh);
+}
+
+void makeMeshCube(IndexedMesh& mesh, float size)
+{
+    std::vector<Vector4f> vertexData, tcoordData;
+    makeMeshCube(vertexData, tcoordData, size);
+    buildIndexedMesh(vertexData, tcoordData, mesh);
+}
@@ -1,8 +1,10 @@
 #include <vector>
 #include <cstdio>
-#include <SDL/SDL.h>
+#include <algorithm>
 #include <linealg.h>
 #include <fixedpoint.h>
+#include <texfilter.h>
+#include "rasterizer.h"
 #include "texture.h"
 #include "myassert.h"
 
@@ -106,6 +108,68 @@ void TriangleSplit(
 }
 
 
+static bool bilinearFiltering = false;
+
+void SetTextureFilter(TextureFilter filter)
+{
+    bilinearFiltering = filter == TEXTURE_BILINEAR;
+}
+
+/* Texel at Q16 texel coordinates. The scale to texels maps s = 0 and
+   s = 1 onto the centers of the first and last texel, so with bilinear
+   filtering the fraction of the texel position weighs in the neighbours
+   to the right and below, clamped at the last column and row. */
+template<bool Bilinear>
+static inline unsigned int sampleTexel(const unsigned int* texels,
+				       unsigned int texWidth, unsigned int texHeight,
+				       long long s, long long t)
+{
+    unsigned int s0 = s >> 16;
+    unsigned int t0 = t >> 16;
+    if(!Bilinear)
+	return texels[s0 + t0*texWidth];
+
+    unsigned int s1 = std::min(s0 + 1, texWidth - 1);
+    unsigned int t1 = std::min(t0 + 1, texHeight - 1);
+    return BilinearBlend(texels[s0 + t0*texWidth], texels[s1 + t0*texWidth],
+			 texels[s0 + t1*texWidth], texels[s1 + t1*texWidth],
+			 (s >> 8) & 255, (t >> 8) & 255);
+}
+
+/* One scanline from PosX to EndX, both inclusive. The texture is read
+   into locals up front, since the compiler can't tell that writes to the
+   buffer leave currentTexture alone. s and t are stepped in texel space,
+   which gives the same values as scaling them at every pixel. */
+template<bool Bilinear>
+static void drawSpan(unsigned int* buffer, unsigned int width, unsigned int height, unsigned int pitch,
+		     int y, int PosX, int EndX, const Vector4i& PosTex, const Vector4i& SlopeTex)
+{
+    const unsigned int* texels = &currentTexture->color[0];
+    unsigned int texWidth = currentTexture->width;
+    unsigned int texHeight = currentTexture->height;
+    long long s = (long long)PosTex.x * (texWidth-1);
+    long long t = (long long)PosTex.y * (texHeight-1);
+    long long slopeS = (long long)SlopeTex.x * (texWidth-1);
+    long long slopeT = (long long)SlopeTex.y * (texHeight-1);
+
+    /* Scissoring is needed for now, because the clipping is inaccurate */
+    if(y < 0 || y >= (int)height)
+	return;
+    if(PosX < 0){
+	s += slopeS * -PosX;
+	t += slopeT * -PosX;
+	PosX = 0;
+    }
+    EndX = std::min(EndX, (int)width - 1);
+    unsigned int* row = &buffer[y*pitch];
+
+    for(; PosX <= EndX; ++PosX){
+	row[PosX] = sampleTexel<Bilinear>(texels, texWidth, texHeight, s, t);
+	s += slopeS;
+	t += slopeT;
+    }
+}
+
 /* Temporary structure for interpolated data.
  Used by TriangleScan() and DrawTriangle()*/
 
@@ -129,7 +193,8 @@ static void TriangleScan(
 		  InterpData tInterp,
 		  unsigned int* buffer,
 		  unsigned int width,
-		  unsigned int height
+		  unsigned int height,
+		  unsigned int pitch
 		  )
 {
     int x0 = vInterp.start.x;
@@ -149,10 +214,6 @@ static void TriangleScan(
 	Vector4i SlopeTex;
 	int xError = PosX - ceilfp(x0);
 	int xDelta = x1 - x0;
-	int column = y0*width;
-                
-        unsigned int texWidth = currentTexture->width;
-        unsigned int texHeight = currentTexture->height;
 
 	if(!xDelta){
 	    SlopeTex = Vector4i(0,0,0);
@@ -172,19 +233,10 @@ static void TriangleScan(
 	PosX >>= 16;
 	EndX >>= 16;
 
-	for(;PosX <= EndX; ++PosX){
-	    unsigned int s = ((long long)PosTex.x * (texWidth-1))>>16ULL;
-	    unsigned int t = ((long long)PosTex.y * (texHeight-1))>>16ULL;
-
-            const unsigned int* texture = &currentTexture->color[0];
-	    unsigned int texel = texture[s + t*texWidth];
-	    /* This if statement is needed for now, because the clipping is inaccurate */
-	    if((PosX >= 0 && PosX < width) && (y0 >= 0 && y0 < height))
-		buffer[PosX + column] = texel;
-                    
-	    PosTex.x   += SlopeTex.x;
-	    PosTex.y   += SlopeTex.y;
-	}
+	if(bilinearFiltering)
+	    drawSpan<true>(buffer, width, height, pitch, y0, PosX, EndX, PosTex, SlopeTex);
+	else
+	    drawSpan<false>(buffer, width, height, pitch, y0, PosX, EndX, PosTex, SlopeTex);
             
 	x0 += vInterp.slope0.x;
 	x1 += vInterp.slope1.x;
@@ -204,7 +256,8 @@ void DrawTriangle(
 		  std::vector<Vector4i>& textureData,
 		  unsigned int* buffer,
 		  unsigned int width,
-		  unsigned int height
+		  unsigned int height,
+		  unsigned int pitch
 		  )
 {
     Vector4i vertexStart, vertexEnd;
@@ -303,6 +356,6 @@ void DrawTriangle(
 				 tcoordSlope0, tcoordSlope1,
 				 tcoordEdge0, tcoordEdge1);
 
-	TriangleScan(vertexInterp, textureInterp, buffer, width, height);
+	TriangleScan(vertexInterp, textureInterp, buffer, width, height, pitch);
     }
 }
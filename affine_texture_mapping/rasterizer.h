@@ -13,12 +13,22 @@ Neither the name of the organization nor the names of its contributors may be us
 #define RASTERIZER_H_GUARD
 #include <linealg.h>
 
+enum TextureFilter
+{
+    TEXTURE_NEAREST=0, /* One texel per pixel */
+    TEXTURE_BILINEAR   /* Weighted average of the four nearest texels */
+};
+
+/* Nearest by default */
+void SetTextureFilter(TextureFilter filter);
+
 void DrawTriangle(
 		  std::vector<Vector4i>& vertexData,
 		  std::vector<Vector4i>& textureData,
 		  unsigned int* buffer,
 		  unsigned int width,
-		  unsigned int height
+		  unsigned int height,
+		  unsigned int pitch     /* Pixels from one row to the next */
 		  );
 void TriangleSplit(
 		   std::vector<Vector4i>& vertexData,
@@ -12,13 +12,24 @@ void BindTexture(const Texture* texture)
 }
 
 
-const struct Texture* ReadPNG(const std::string& name)
+static unsigned int premultiplyTexel(unsigned int c)
+{
+    unsigned int alpha = c >> 24;
+    unsigned int result = c & 0xFF000000;
+    for(int shift=0; shift<24; shift+=8)
+        result |= ((((c >> shift) & 255) * alpha + 127) / 255) << shift;
+    return result;
+}
+
+
+const struct Texture* ReadPNG(const std::string& name, TextureFormat format)
 {
     Texture *texture;
     ILuint img;
     ilGenImages(1, &img);
     ilBindImage(img);
     if(!ilLoadImage(name.c_str())){
+        ilDeleteImages(1, &img);
         return nullptr;
     }
     iluFlipImage();
@@ -27,8 +38,13 @@ const struct Texture* ReadPNG(const std::string& name)
     texture->width = ilGetInteger(IL_IMAGE_WIDTH);
     texture->height = ilGetInteger(IL_IMAGE_HEIGHT);
     texture->color.resize(texture->width * texture->height);
-    ilCopyPixels(0, 0, 0, texture->width, texture->height, 1, IL_RGBA, IL_UNSIGNED_BYTE, &texture->color[0]);
+    ilCopyPixels(0, 0, 0, texture->width, texture->height, 1,
+                 (format & TEXTURE_FORMAT_SWAPPED) ? IL_BGRA : IL_RGBA, IL_UNSIGNED_BYTE, &texture->color[0]);
     ilDeleteImages(1, &img);
+    if(format & TEXTURE_FORMAT_PREMULTIPLIED){
+        for(size_t i=0; i<texture->color.size(); ++i)
+            texture->color[i] = premultiplyTexel(texture->color[i]);
+    }
 
     return texture;
 }
@@ -10,8 +10,22 @@ struct Texture
     unsigned int height;
 };
 
+/* Byte order of the 32-bit texels, and whether the color channels are
+   premultiplied by alpha. Bit 0 is the byte order, bit 1 premultiplication. */
+enum TextureFormat
+{
+    TEXTURE_RGBA8=0,              /* R, G, B, A, as DevIL hands them out */
+    TEXTURE_BGRA8,                /* B, G, R, A, a 32-bit SDL surface on little endian machines */
+    TEXTURE_RGBA8_PREMULTIPLIED,
+    TEXTURE_BGRA8_PREMULTIPLIED
+};
+
+#define TEXTURE_FORMAT_SWAPPED 1
+#define TEXTURE_FORMAT_PREMULTIPLIED 2
 
-const struct Texture* ReadPNG(const std::string& name);
+/* Loads the image with its texels already in 'format', so the rasterizer
+   can store them in the framebuffer as they are */
+const struct Texture* ReadPNG(const std::string& name, TextureFormat format = TEXTURE_RGBA8);
 void BindTexture(const Texture* texture);
 
 extern const struct Texture* currentTexture;
@@ -13,6 +13,6 @@ Neither the name of the organization nor the names of its contributors may be us
 #define LINE_BRESENHAM_GUARD_H
 #include <linealg.h>
 
-void drawLine(const Vector4f& v1, const Vector4f& v2, unsigned int* buffer, int width, int height);
+void drawLine(const Vector4f& v1, const Vector4f& v2, unsigned int* buffer, int pitch, int height);
 
 #endif
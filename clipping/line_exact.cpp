@@ -5,7 +5,7 @@
 /* draw an y-major line, that is -1 < x/y < 1
    Called internally by drawLine() */
 static void drawLineYMajor(const Vector2i& p1, const Vector2i& p2,
-						   unsigned int* buffer, int width, int height)
+						   unsigned int* buffer, int pitch, int height)
 {	
 	assert(p2.y >= p1.y);
 	Vector2i edge = p2-p1;
@@ -20,14 +20,14 @@ static void drawLineYMajor(const Vector2i& p1, const Vector2i& p2,
 			x += sign;
 			xAccum -= edge.y;			
 		}		
-		buffer[x + y * width] = 0xFFFFFFFF;		
+		buffer[x + y * pitch] = 0xFFFFFFFF;		
 	}
 }
 
 /* draw an x-major line, that is -1 < y/x < 1
    Called internally by drawLine() */
 static void drawLineXMajor(const Vector2i& p1, const Vector2i& p2,
-						   unsigned int* buffer, int width, int height)
+						   unsigned int* buffer, int pitch, int height)
 {
 	assert(p2.x >= p1.x);
 	Vector2i edge = p2 - p1;
@@ -42,14 +42,14 @@ static void drawLineXMajor(const Vector2i& p1, const Vector2i& p2,
 			y += sign;
 			yAccum -= edge.x;			
 		}		
-		buffer[x + y * width] = 0xFFFFFFFF;		
+		buffer[x + y * pitch] = 0xFFFFFFFF;		
 	}
 }
 
 /* A straight vertical line, which is a special case. The y direction is 0, so x/y = Inf
    Called internally by drawLine() */
 static void drawLineVertical(Vector4f v1, Vector4f v2,
-							 unsigned int* buffer, int width, int height)
+							 unsigned int* buffer, int pitch, int height)
 {
     if(v2.y < v1.y)
 		std::swap(v1, v2);
@@ -58,13 +58,13 @@ static void drawLineVertical(Vector4f v1, Vector4f v2,
     int y2 = v2.y;
 	
     for(int y=v1.y; y<v2.y; ++y)
-		buffer[x + y*width] = 0xFFFFFFFF;
+		buffer[x + y*pitch] = 0xFFFFFFFF;
 }
 
 /* A straight horisontal line, which is a special case. The x direction is 0, so y/x = Inf
    Called internally by drawLine() */
 static void drawLineHorisontal(Vector4f v1, Vector4f v2,
-							   unsigned int* buffer, int width, int height)
+							   unsigned int* buffer, int pitch, int height)
 {
     if(v2.x < v1.x)
 		std::swap(v1, v2);
@@ -73,12 +73,12 @@ static void drawLineHorisontal(Vector4f v1, Vector4f v2,
     int x2 = v2.x;
 	
     for(int x=v1.x; x<v2.x; ++x)
-		buffer[x + y*width] = 0xFFFFFFFF;
+		buffer[x + y*pitch] = 0xFFFFFFFF;
 }
 
 /* Our externally visible function, which draws lines with the Bresenham algorithm */
 void drawLine(const Vector4f& v1, const Vector4f& v2,
-			  unsigned int* buffer, int width, int height)
+			  unsigned int* buffer, int pitch, int height)
 {
 	Vector2i p1(v1.x, v1.y);
 	Vector2i p2(v2.x, v2.y);
@@ -94,11 +94,11 @@ void drawLine(const Vector4f& v1, const Vector4f& v2,
 		   smallest x to the largest x. Remember that our framebuffer holds pixels in increasing x */
 		if(p2.x < p1.x)
 			std::swap(p1, p2);
-		drawLineHorisontal(v1, v2, buffer, width, height);
+		drawLineHorisontal(v1, v2, buffer, pitch, height);
 	} else if(!edge.x){
 		if(p2.y < p1.y)
 			std::swap(p1, p2);
-		drawLineVertical(v1, v2, buffer, width, height);
+		drawLineVertical(v1, v2, buffer, pitch, height);
 	} else {
 		/* sloped line */
 		
@@ -106,12 +106,12 @@ void drawLine(const Vector4f& v1, const Vector4f& v2,
 		if(std::abs(edge.x) < std::abs(edge.y)){
 			if(p2.y < p1.y)
 				std::swap(p1, p2);
-			drawLineYMajor(p1, p2, buffer, width, height);
+			drawLineYMajor(p1, p2, buffer, pitch, height);
 		} else {
 			/* x major */
 			if(p2.x < p1.x)
 				std::swap(p1, p2);			
-			drawLineXMajor(p1, p2, buffer, width, height);
+			drawLineXMajor(p1, p2, buffer, pitch, height);
 		}
 	}
 	return;
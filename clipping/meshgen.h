@@ -12,7 +12,11 @@ Neither the name of the organization nor the names of its contributors may be us
 #ifndef MESHGEN_GUARD_H
 #define MESHGEN_GUARD_H
 #include <linealg.h>
+#include <mesh.h>
 
 void makeMeshSphere(std::vector<Vector4f>& dst, float radius);
 void makeMeshCircle(std::vector<Vector4f>& dst, float radius);
+/* Indexed versions of the above, every shared corner stored once */
+void makeMeshSphere(IndexedMesh& mesh, float radius);
+void makeMeshCircle(IndexedMesh& mesh, float radius);
 #endif
@@ -0,0 +1,282 @@
+/*
+Copyright (c) 2013, Mads Andreas Elvheim
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+*/
+
+
+#ifndef DISPLAY_H_GUARD
+#define DISPLAY_H_GUARD
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <framewriter.h>
+#ifndef CGE_HEADLESS
+#include <SDL/SDL.h>
+#endif
+
+/* Where the demos draw their frames: a window through SDL, or a buffer
+   in memory for machines without a display and for timing the
+   rasterizer alone. Builds with CGE_HEADLESS defined leave SDL out and
+   only have the memory backend.
+
+   The frames are 32-bit pixels, 'pitch' pixels from one row to the
+   next. A headless display has no events, and its clock moves 1/60th of
+   a second per frame, so two runs draw the same frames. */
+
+/* Keys are SDL 1.2 key symbols, letters are their lower case ASCII code */
+enum DisplayKey
+{
+    DISPLAY_KEY_NONE = 0,
+    DISPLAY_KEY_TAB = 9,
+    DISPLAY_KEY_ESCAPE = 27
+};
+
+struct DisplayOptions
+{
+    DisplayOptions(unsigned int w, unsigned int h) : width(w), height(h), frames(0), headless(false) {}
+
+    unsigned int width;
+    unsigned int height;
+    unsigned int frames;  /* Stop after this many frames, 0 runs until closed */
+    std::string output;   /* File every frame is written to, see FrameWriter */
+    bool headless;
+};
+
+/* Reads the options from the command line, on top of the defaults held
+   in 'options'. Prints the usage and returns false on anything it
+   doesn't know. */
+inline bool ParseDisplayOptions(int argc, char* argv[], DisplayOptions& options)
+{
+    for(int i=1; i<argc; ++i){
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if(arg == "--headless"){
+            options.headless = true;
+            continue;
+        }
+        if(hasValue && arg == "--output" && ValidOutputPattern(argv[i + 1])){
+            options.output = argv[++i];
+            continue;
+        }
+        unsigned int* number = arg == "--width" ? &options.width :
+                               arg == "--height" ? &options.height :
+                               arg == "--frames" ? &options.frames : NULL;
+        char* end = NULL;
+        unsigned long value = hasValue ? strtoul(argv[i + 1], &end, 10) : 0;
+        if(number && hasValue && end != argv[i + 1] && !*end && (value || number == &options.frames)){
+            *number = (unsigned int)value;
+            ++i;
+            continue;
+        }
+        printf("Usage: %s [--width N] [--height N] [--frames N] [--output file] [--headless]\n"
+               "  --width, --height  Resolution, %ux%u by default\n"
+               "  --frames           Quit after N frames and report the time per frame\n"
+               "  --output           Write every frame to a .png, .ppm, or one .y4m stream.\n"
+               "                     A printf pattern such as frame%%04d.png numbers the files.\n"
+               "  --headless         Draw into memory instead of a window\n",
+               argv[0], options.width, options.height);
+        return false;
+    }
+#ifdef CGE_HEADLESS
+    options.headless = true;
+#endif
+    return true;
+}
+
+class Display
+{
+public:
+    explicit Display(const DisplayOptions& displayOptions) :
+        options(displayOptions), open(true), frame(0), started(false)
+    {
+        if(!options.output.empty())
+            writer.reset(new FrameWriter(options.output, options.width, options.height));
+    }
+
+    /* With --frames, reports the time from the first lock() to the last
+       present(), which leaves out loading. Writing the frames still
+       queued at exit is reported on its own. */
+    virtual ~Display()
+    {
+        std::chrono::steady_clock::time_point drainStart = std::chrono::steady_clock::now();
+        bool draining = writer != NULL;
+        writer.reset();
+        if(!options.frames || !frame)
+            return;
+        double seconds = std::chrono::duration<double>(end - start).count();
+        printf("%u frames at %ux%u in %.2f s, %.3f ms per frame\n",
+               frame, options.width, options.height, seconds, seconds * 1000.0 / frame);
+        if(draining)
+            printf("Writing the queued frames took another %.1f ms\n",
+                   std::chrono::duration<double>(std::chrono::steady_clock::now() - drainStart).count() * 1000.0);
+    }
+
+    unsigned int width() const { return options.width; }
+    unsigned int height() const { return options.height; }
+
+    /* False once the window is closed or the frame count is reached */
+    bool running() const { return open; }
+    void close() { open = false; }
+
+    /* The next key pressed, or DISPLAY_KEY_NONE when there are no more */
+    virtual int pollKey() { return DISPLAY_KEY_NONE; }
+    /* Milliseconds since the display opened */
+    virtual unsigned int ticks() { return frame * 1000 / 60; }
+    /* True when the pixel bytes are B, G, R, A in memory, R, G, B, A otherwise */
+    virtual bool bgra() const = 0;
+
+    /* The pixels of the next frame, valid until present() */
+    unsigned int* lock(unsigned int& pitch)
+    {
+        if(!started){
+            started = true;
+            start = std::chrono::steady_clock::now();
+        }
+        return lockFrame(pitch);
+    }
+    /* Shows the frame and queues it for the output file */
+    void present()
+    {
+        if(writer){
+            unsigned int pitch;
+            const unsigned int* pixels = frameData(pitch);
+            writer->write(pixels, pitch, bgra());
+        }
+        show();
+        end = std::chrono::steady_clock::now();
+        ++frame;
+        if(options.frames && frame >= options.frames)
+            open = false;
+    }
+
+protected:
+    virtual unsigned int* lockFrame(unsigned int& pitch) = 0;
+    /* The frame as lock() handed it out, between lock and present */
+    virtual const unsigned int* frameData(unsigned int& pitch) = 0;
+    virtual void show() = 0;
+
+    DisplayOptions options;
+
+private:
+    bool open;
+    unsigned int frame;
+    bool started;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point end;
+    std::unique_ptr<FrameWriter> writer;
+};
+
+/* Frames in a buffer that is never shown */
+class MemoryDisplay : public Display
+{
+public:
+    explicit MemoryDisplay(const DisplayOptions& displayOptions) :
+        Display(displayOptions), pixels((size_t)displayOptions.width * displayOptions.height) {}
+
+    bool bgra() const { return true; }
+
+protected:
+    unsigned int* lockFrame(unsigned int& pitch)
+    {
+        pitch = options.width;
+        return &pixels[0];
+    }
+    const unsigned int* frameData(unsigned int& pitch)
+    {
+        pitch = options.width;
+        return &pixels[0];
+    }
+    void show() {}
+
+private:
+    std::vector<unsigned int> pixels;
+};
+
+#ifndef CGE_HEADLESS
+/* A double buffered 32-bit SDL window */
+class SDLDisplay : public Display
+{
+public:
+    SDLDisplay(const DisplayOptions& displayOptions, const char* caption) : Display(displayOptions), screen(NULL)
+    {
+        SDL_Init(SDL_INIT_VIDEO);
+        screen = SDL_SetVideoMode(options.width, options.height, 32, SDL_DOUBLEBUF | SDL_SWSURFACE);
+        SDL_WM_SetCaption(caption, NULL);
+        if(!screen){
+            printf("Couldn't open a %ux%u window\n", options.width, options.height);
+            close();
+        }
+    }
+
+    ~SDLDisplay()
+    {
+        SDL_Quit();
+    }
+
+    int pollKey()
+    {
+        SDL_Event event;
+        while(SDL_PollEvent(&event)){
+            if(event.type == SDL_QUIT)
+                close();
+            if(event.type == SDL_KEYDOWN)
+                return event.key.keysym.sym;
+        }
+        return DISPLAY_KEY_NONE;
+    }
+
+    unsigned int ticks() { return SDL_GetTicks(); }
+
+    /* The red mask of a little endian BGRA surface is 0x00FF0000. Any
+       other 32-bit surface is taken to be RGBA. */
+    bool bgra() const
+    {
+        Uint32 red = 0;
+        reinterpret_cast<unsigned char*>(&red)[2] = 0xFF;
+        return screen && screen->format->Rmask == red;
+    }
+
+protected:
+    unsigned int* lockFrame(unsigned int& pitch)
+    {
+        SDL_LockSurface(screen);
+        return const_cast<unsigned int*>(frameData(pitch));
+    }
+
+    const unsigned int* frameData(unsigned int& pitch)
+    {
+        pitch = screen->pitch / sizeof(Uint32);
+        return static_cast<const unsigned int*>(screen->pixels);
+    }
+
+    void show()
+    {
+        SDL_UnlockSurface(screen);
+        SDL_Flip(screen);
+    }
+
+private:
+    SDL_Surface* screen;
+};
+#endif
+
+/* A window unless the options ask for a headless display */
+inline Display* OpenDisplay(const DisplayOptions& options, const char* caption)
+{
+#ifndef CGE_HEADLESS
+    if(!options.headless)
+        return new SDLDisplay(options, caption);
+#endif
+    (void)caption;
+    return new MemoryDisplay(options);
+}
+#endif
@@ -0,0 +1,388 @@
+/*
+Copyright (c) 2013, Mads Andreas Elvheim
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+*/
+
+
+#ifndef FRAMEWRITER_H_GUARD
+#define FRAMEWRITER_H_GUARD
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <zlib.h>
+#include <threadpool.h>
+
+/* Writes rendered frames to disk from a background thread, so drawing
+   the next frame overlaps writing the last one. The name picks the format:
+
+     .png   RGB PNG. Rows are filtered and deflated in groups, one group
+            per job on a thread pool. Every group is a raw deflate stream
+            of its own, ended with a sync flush so it stops on a byte
+            boundary. Put one after another they make a single zlib
+            stream, whose Adler-32 is combined from those of the groups.
+     .y4m   One YUV4MPEG2 stream holding every frame, 4:4:4 BT.601. Made
+            for piping straight into a video encoder.
+     other  Binary PPM, the cheapest to write.
+
+   PNG and PPM names may hold one printf %d for the frame number. The
+   frames are 32-bit pixels with red in the first or third byte, and
+   alpha is dropped. */
+
+enum FrameFormat
+{
+    FRAME_PPM,
+    FRAME_PNG,
+    FRAME_Y4M
+};
+
+/* Rows are handed out to the pool in groups of about this many bytes */
+#define FRAME_GROUP_BYTES (128*1024)
+/* Frames waiting to be written before write() blocks */
+#define FRAME_QUEUE_LENGTH 3
+
+inline FrameFormat FrameFormatFromName(const std::string& name)
+{
+    size_t dot = name.rfind('.');
+    std::string extension = dot == std::string::npos ? "" : name.substr(dot + 1);
+    for(size_t i=0; i<extension.size(); ++i)
+        extension[i] = (char)tolower((unsigned char)extension[i]);
+    if(extension == "png")
+        return FRAME_PNG;
+    if(extension == "y4m")
+        return FRAME_Y4M;
+    return FRAME_PPM;
+}
+
+/* Output names may hold one printf conversion, for the frame number */
+inline bool ValidOutputPattern(const std::string& pattern)
+{
+    size_t i = pattern.find('%');
+    if(i == std::string::npos)
+        return true;
+    i = pattern.find_first_not_of("0123456789", i + 1);
+    return i != std::string::npos && pattern[i] == 'd' && pattern.find('%', i) == std::string::npos;
+}
+
+class FrameWriter
+{
+public:
+    /* 'level' is the zlib compression level of PNG frames. The fastest
+       level keeps up with the rasterizer, the rest mostly shrink the
+       flat areas further. The writer thread helps the pool, so it gets
+       one thread less. */
+    FrameWriter(const std::string& outputName, unsigned int frameWidth, unsigned int frameHeight,
+                unsigned int threadCount = std::thread::hardware_concurrency(),
+                int level = Z_BEST_SPEED, unsigned int framesPerSecond = 60) :
+        name(outputName), format(FrameFormatFromName(outputName)),
+        width(frameWidth), height(frameHeight), compression(level), fps(framesPerSecond),
+        stopping(false), submitted(0), failed(false), stream(NULL),
+        pool(threadCount > 1 ? threadCount - 1 : 1)
+    {
+        rowsPerGroup = std::max<unsigned int>(1, FRAME_GROUP_BYTES / (width*3));
+        groups.resize((height + rowsPerGroup - 1) / rowsPerGroup);
+        writer = std::thread(&FrameWriter::writerLoop, this);
+    }
+
+    /* Writes every queued frame before returning */
+    ~FrameWriter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queuedCondition.notify_all();
+        writer.join();
+        if(stream)
+            fclose(stream);
+    }
+
+    /* Copies the frame and queues it, rows 'pitch' pixels apart. Waits
+       while FRAME_QUEUE_LENGTH frames are already queued, so a slow disk
+       holds the renderer back rather than filling memory. Call it from
+       one thread. */
+    void write(const unsigned int* pixels, unsigned int pitch, bool bgra)
+    {
+        Frame frame;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            spaceCondition.wait(lock, [this](){ return queue.size() < FRAME_QUEUE_LENGTH; });
+            if(!spare.empty()){
+                frame.pixels.swap(spare.back());
+                spare.pop_back();
+            }
+        }
+        frame.number = submitted++;
+        frame.bgra = bgra;
+        frame.pixels.resize((size_t)width * height);
+        for(unsigned int y=0; y<height; ++y)
+            memcpy(&frame.pixels[(size_t)y*width], pixels + (size_t)y*pitch, width*sizeof(unsigned int));
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            queue.push_back(std::move(frame));
+        }
+        queuedCondition.notify_one();
+    }
+
+private:
+    struct Frame
+    {
+        unsigned int number;
+        bool bgra;
+        std::vector<unsigned int> pixels;
+    };
+
+    /* One group of PNG rows, filtered and then deflated */
+    struct Group
+    {
+        std::vector<unsigned char> filtered;
+        std::vector<unsigned char> compressed;
+        uLong adler;
+        bool ok;
+    };
+
+    void writerLoop()
+    {
+        for(;;){
+            Frame frame;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queuedCondition.wait(lock, [this](){ return stopping || !queue.empty(); });
+                if(queue.empty())
+                    return;
+                frame = std::move(queue.front());
+                queue.pop_front();
+            }
+            spaceCondition.notify_one();
+
+            if(!failed){
+                if(format == FRAME_PNG)
+                    writePNG(frame);
+                else if(format == FRAME_Y4M)
+                    writeY4M(frame);
+                else
+                    writePPM(frame);
+            }
+
+            std::lock_guard<std::mutex> lock(queueMutex);
+            spare.push_back(std::move(frame.pixels));
+        }
+    }
+
+    std::string frameName(unsigned int number) const
+    {
+        if(name.find('%') == std::string::npos)
+            return name;
+        std::vector<char> formatted(name.size() + 32);
+        snprintf(&formatted[0], formatted.size(), name.c_str(), (int)number);
+        return &formatted[0];
+    }
+
+    /* Opens the output, and gives up on the rest of the frames if it can't */
+    FILE* open(const std::string& fileName)
+    {
+        FILE* out = fopen(fileName.c_str(), "wb");
+        if(!out){
+            printf("Couldn't write %s\n", fileName.c_str());
+            failed = true;
+        }
+        return out;
+    }
+
+    void rgbRow(const Frame& frame, unsigned int y, unsigned char* out) const
+    {
+        const unsigned char* src = reinterpret_cast<const unsigned char*>(&frame.pixels[(size_t)y*width]);
+        int red = frame.bgra ? 2 : 0;
+        for(unsigned int x=0; x<width; ++x){
+            out[x*3 + 0] = src[x*4 + red];
+            out[x*3 + 1] = src[x*4 + 1];
+            out[x*3 + 2] = src[x*4 + 2 - red];
+        }
+    }
+
+    template<class F> void forEachGroup(F func)
+    {
+        pool.parallelFor(groups.size(), [&](unsigned int group)
+        {
+            unsigned int y0 = group * rowsPerGroup;
+            func(group, y0, std::min(y0 + rowsPerGroup, height));
+        });
+    }
+
+    void writePPM(const Frame& frame)
+    {
+        rgb.resize((size_t)width * height * 3);
+        forEachGroup([&](unsigned int, unsigned int y0, unsigned int y1)
+        {
+            for(unsigned int y=y0; y<y1; ++y)
+                rgbRow(frame, y, &rgb[(size_t)y*width*3]);
+        });
+        FILE* out = open(frameName(frame.number));
+        if(!out)
+            return;
+        fprintf(out, "P6\n%u %u\n255\n", width, height);
+        fwrite(&rgb[0], 1, rgb.size(), out);
+        fclose(out);
+    }
+
+    void writeY4M(const Frame& frame)
+    {
+        size_t planeSize = (size_t)width * height;
+        rgb.resize(planeSize * 3);
+        forEachGroup([&](unsigned int, unsigned int y0, unsigned int y1)
+        {
+            std::vector<unsigned char> row(width * 3);
+            for(unsigned int y=y0; y<y1; ++y){
+                rgbRow(frame, y, &row[0]);
+                unsigned char* Y = &rgb[(size_t)y*width];
+                unsigned char* U = Y + planeSize;
+                unsigned char* V = U + planeSize;
+                for(unsigned int x=0; x<width; ++x){
+                    int r = row[x*3], g = row[x*3 + 1], b = row[x*3 + 2];
+                    Y[x] = (unsigned char)((( 66*r + 129*g +  25*b + 128) >> 8) + 16);
+                    U[x] = (unsigned char)(((-38*r -  74*g + 112*b + 128) >> 8) + 128);
+                    V[x] = (unsigned char)(((112*r -  94*g -  18*b + 128) >> 8) + 128);
+                }
+            }
+        });
+        if(!stream){
+            stream = open(name);
+            if(!stream)
+                return;
+            fprintf(stream, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C444\n", width, height, fps);
+        }
+        fputs("FRAME\n", stream);
+        fwrite(&rgb[0], 1, rgb.size(), stream);
+    }
+
+    static void put32(unsigned char* out, unsigned int value)
+    {
+        out[0] = (unsigned char)(value >> 24);
+        out[1] = (unsigned char)(value >> 16);
+        out[2] = (unsigned char)(value >> 8);
+        out[3] = (unsigned char)value;
+    }
+
+    static void writeChunk(FILE* out, const char* type, const unsigned char* data, unsigned int size)
+    {
+        unsigned char header[8], crc[4];
+        put32(header, size);
+        memcpy(header + 4, type, 4);
+        uLong sum = crc32(crc32(0, Z_NULL, 0), header + 4, 4);
+        if(size)
+            sum = crc32(sum, data, size);
+        put32(crc, (unsigned int)sum);
+        fwrite(header, 1, 8, out);
+        if(size)
+            fwrite(data, 1, size, out);
+        fwrite(crc, 1, 4, out);
+    }
+
+    /* Filters rows [y0, y1) with the Sub filter, and deflates them.
+       Only the last group finishes the deflate stream. */
+    void compressGroup(const Frame& frame, Group& group, unsigned int y0, unsigned int y1, bool last)
+    {
+        size_t rowBytes = (size_t)width*3 + 1;
+        group.filtered.resize((y1 - y0) * rowBytes);
+        for(unsigned int y=y0; y<y1; ++y){
+            unsigned char* row = &group.filtered[(y - y0) * rowBytes];
+            row[0] = 1;
+            rgbRow(frame, y, row + 1);
+            for(size_t i=rowBytes-1; i>3; --i)
+                row[i] -= row[i - 3];
+        }
+        group.adler = adler32(adler32(0, Z_NULL, 0), &group.filtered[0], group.filtered.size());
+
+        z_stream z;
+        memset(&z, 0, sizeof(z));
+        group.ok = deflateInit2(&z, compression, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+        if(!group.ok)
+            return;
+        /* The bound is for Z_FINISH, a sync flush adds an empty stored block */
+        group.compressed.resize(deflateBound(&z, group.filtered.size()) + 16);
+        z.next_in = &group.filtered[0];
+        z.avail_in = group.filtered.size();
+        z.next_out = &group.compressed[0];
+        z.avail_out = group.compressed.size();
+        int result = deflate(&z, last ? Z_FINISH : Z_SYNC_FLUSH);
+        group.ok = last ? result == Z_STREAM_END : result == Z_OK && !z.avail_in && z.avail_out;
+        group.compressed.resize(z.total_out);
+        deflateEnd(&z);
+    }
+
+    void writePNG(const Frame& frame)
+    {
+        forEachGroup([&](unsigned int i, unsigned int y0, unsigned int y1)
+        {
+            compressGroup(frame, groups[i], y0, y1, i + 1 == groups.size());
+        });
+
+        /* The zlib header, every group, and the combined Adler-32 */
+        idat.assign(1, 0x78);
+        idat.push_back(0x01);
+        uLong adler = adler32(0, Z_NULL, 0);
+        for(size_t i=0; i<groups.size(); ++i){
+            if(!groups[i].ok){
+                printf("Couldn't compress frame %u\n", frame.number);
+                return;
+            }
+            idat.insert(idat.end(), groups[i].compressed.begin(), groups[i].compressed.end());
+            adler = adler32_combine(adler, groups[i].adler, groups[i].filtered.size());
+        }
+        idat.resize(idat.size() + 4);
+        put32(&idat[idat.size() - 4], (unsigned int)adler);
+
+        FILE* out = open(frameName(frame.number));
+        if(!out)
+            return;
+        static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        /* 8 bits per channel, RGB, no interlacing */
+        unsigned char header[13] = { 0, 0, 0, 0, 0, 0, 0, 0, 8, 2, 0, 0, 0 };
+        put32(header, width);
+        put32(header + 4, height);
+        fwrite(signature, 1, 8, out);
+        writeChunk(out, "IHDR", header, 13);
+        writeChunk(out, "IDAT", &idat[0], idat.size());
+        writeChunk(out, "IEND", NULL, 0);
+        fclose(out);
+    }
+
+    std::string name;
+    FrameFormat format;
+    unsigned int width;
+    unsigned int height;
+    int compression;
+    unsigned int fps;
+    unsigned int rowsPerGroup;
+
+    std::deque<Frame> queue;
+    std::vector< std::vector<unsigned int> > spare;  /* Pixels of written frames, for reuse */
+    std::mutex queueMutex;
+    std::condition_variable queuedCondition;
+    std::condition_variable spaceCondition;
+    bool stopping;
+
+    unsigned int submitted;  /* Frames passed to write() */
+
+    /* The writer thread's own */
+    bool failed;
+    FILE* stream;                      /* The Y4M stream */
+    std::vector<Group> groups;
+    std::vector<unsigned char> rgb;    /* PPM and Y4M frames */
+    std::vector<unsigned char> idat;
+    ThreadPool pool;
+    std::thread writer;
+};
+#endif
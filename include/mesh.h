@@ -0,0 +1,146 @@
+/*
+Copyright (c) 2013, Mads Andreas Elvheim
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+*/
+
+#ifndef MESH_H_GUARD
+#define MESH_H_GUARD
+#include <vector>
+#include <cstring>
+#include <unordered_map>
+#include "linealg.h"
+#include "vertexstream.h"
+
+/* A triangle list as a vertex buffer plus an index buffer, three indices
+   per triangle. Shared corners are stored once, so the transform only
+   runs once per unique vertex. The indices are 16-bit whenever the
+   vertex count allows it, and only one of the two index lists is used. */
+struct IndexedMesh
+{
+    std::vector<Vector4f> vertices;
+    std::vector<Vector4f> tcoords;  /* Empty, or one per vertex */
+    std::vector<unsigned short> indices16;
+    std::vector<unsigned int> indices32;
+
+    bool wideIndices() const
+    {
+        return !indices32.empty();
+    }
+
+    size_t indexCount() const
+    {
+        return wideIndices() ? indices32.size() : indices16.size();
+    }
+
+    unsigned int index(size_t i) const
+    {
+        return wideIndices() ? indices32[i] : indices16[i];
+    }
+
+    void clear()
+    {
+        vertices.clear();
+        tcoords.clear();
+        indices16.clear();
+        indices32.clear();
+    }
+};
+
+namespace mesh_detail
+{
+    /* Position and texture coordinate of a corner. Corners are merged only
+       when they are bit-identical, so indexing never moves a vertex. */
+    struct CornerKey
+    {
+        float data[8];
+        bool operator==(const CornerKey& k) const
+        {
+            return std::memcmp(data, k.data, sizeof(data)) == 0;
+        }
+    };
+
+    struct CornerHash
+    {
+        size_t operator()(const CornerKey& k) const
+        {
+            unsigned int bits[8];
+            std::memcpy(bits, k.data, sizeof(bits));
+            size_t h = 2166136261u;
+            for(int i=0; i<8; ++i)
+                h = (h ^ bits[i]) * 16777619u;
+            return h;
+        }
+    };
+}
+
+/* Builds an indexed mesh from an expanded triangle list. tcoordData may
+   be empty, otherwise it has one entry per corner. */
+inline void buildIndexedMesh(const std::vector<Vector4f>& vertexData,
+                             const std::vector<Vector4f>& tcoordData,
+                             IndexedMesh& mesh)
+{
+    std::unordered_map<mesh_detail::CornerKey, unsigned int, mesh_detail::CornerHash> corners;
+    std::vector<unsigned int> indices(vertexData.size());
+    bool textured = !tcoordData.empty();
+
+    mesh.clear();
+    for(size_t i=0; i<vertexData.size(); ++i){
+        const Vector4f& v = vertexData[i];
+        Vector4f t = textured ? tcoordData[i] : Vector4f(0.0f, 0.0f, 0.0f, 0.0f);
+        mesh_detail::CornerKey key = {{ v.x, v.y, v.z, v.w, t.x, t.y, t.z, t.w }};
+        std::pair<std::unordered_map<mesh_detail::CornerKey, unsigned int, mesh_detail::CornerHash>::iterator, bool>
+            found = corners.insert(std::make_pair(key, (unsigned int)mesh.vertices.size()));
+        if(found.second){
+            mesh.vertices.push_back(v);
+            if(textured)
+                mesh.tcoords.push_back(t);
+        }
+        indices[i] = found.first->second;
+    }
+
+    if(mesh.vertices.size() <= 65536)
+        mesh.indices16.assign(indices.begin(), indices.end());
+    else
+        mesh.indices32.swap(indices);
+}
+
+/* The other way around, for code that wants a plain triangle list */
+inline void expandIndexedMesh(const IndexedMesh& mesh,
+                              std::vector<Vector4f>& vertexData,
+                              std::vector<Vector4f>& tcoordData)
+{
+    size_t count = mesh.indexCount();
+    vertexData.resize(count);
+    tcoordData.resize(mesh.tcoords.empty() ? 0 : count);
+    for(size_t i=0; i<count; ++i){
+        unsigned int index = mesh.index(i);
+        vertexData[i] = mesh.vertices[index];
+        if(!mesh.tcoords.empty())
+            tcoordData[i] = mesh.tcoords[index];
+    }
+}
+
+/* Expands transformed vertices, one per mesh vertex, into a triangle list.
+   This is the post-transform cache: every corner reads the result of its
+   vertex instead of transforming it again. */
+inline void gatherTriangles(const VertexStream& transformed, const IndexedMesh& mesh,
+                            std::vector<Vector4f>& dst)
+{
+    size_t count = mesh.indexCount();
+    dst.resize(count);
+    if(mesh.wideIndices()){
+        for(size_t i=0; i<count; ++i)
+            dst[i] = transformed.get(mesh.indices32[i]);
+    } else {
+        for(size_t i=0; i<count; ++i)
+            dst[i] = transformed.get(mesh.indices16[i]);
+    }
+}
+
+#endif
@@ -0,0 +1,504 @@
+/*
+Copyright (c) 2013, Mads Andreas Elvheim
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+*/
+
+#ifndef MESHOPT_H_GUARD
+#define MESHOPT_H_GUARD
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cmath>
+#include <cfloat>
+#include "linealg.h"
+#include "mesh.h"
+
+/* Triangle and vertex reordering for indexed meshes. None of these move a
+   vertex or change which triangles there are, only the order they come in:
+
+   optimizeVertexCache - Tom Forsyth's linear-speed vertex cache optimizer
+   optimizeOverdraw    - Splits the cache-friendly order into clusters and
+                         sorts them so outward facing clusters come first
+                         (Sander, Nehab and Barczak, "Fast Triangle
+                         Reordering for Vertex Locality and Reduced Overdraw")
+   optimizeVertexFetch - Renumbers the vertices in the order they are first used
+
+   The passes are run in that order, as optimizeMesh does. They are cheap
+   enough to run at load time, and the result can just as well be saved. */
+
+/* Cache size assumed by analyzeVertexCache, a small FIFO like on the GPUs
+   the ACMR numbers in the literature come from */
+#define MESH_FIFO_CACHE_SIZE 16
+
+namespace meshopt_detail
+{
+    /* The LRU cache the Forsyth scoring is tuned for */
+    const int kCacheSize = 32;
+
+    inline void getIndices(const IndexedMesh& mesh, std::vector<unsigned int>& indices)
+    {
+        indices.resize(mesh.indexCount());
+        for(size_t i=0; i<indices.size(); ++i)
+            indices[i] = mesh.index(i);
+    }
+
+    /* Stores the indices back with the same width rule as buildIndexedMesh */
+    inline void setIndices(IndexedMesh& mesh, std::vector<unsigned int>& indices)
+    {
+        mesh.indices16.clear();
+        mesh.indices32.clear();
+        if(mesh.vertices.size() <= 65536)
+            mesh.indices16.assign(indices.begin(), indices.end());
+        else
+            mesh.indices32.swap(indices);
+    }
+
+    inline float vertexScore(int cachePosition, unsigned int remaining)
+    {
+        /* Vertices without triangles left are never picked again */
+        if(!remaining)
+            return -1.0f;
+
+        float score = 0.0f;
+        if(cachePosition >= 0){
+            /* The last triangle's vertices get a fixed score, so that the
+               next triangle doesn't just reuse its edge and make strips */
+            if(cachePosition < 3)
+                score = 0.75f;
+            else
+                score = std::pow(1.0f - (cachePosition - 3) * (1.0f / (kCacheSize - 3)), 1.5f);
+        }
+        /* Favour vertices with few triangles left, so they are finished off
+           instead of leaving lone triangles behind for later */
+        return score + 2.0f * std::pow((float)remaining, -0.5f);
+    }
+
+    /* Triangle adjacency of every vertex, as one list with offsets */
+    struct Adjacency
+    {
+        std::vector<unsigned int> offsets;
+        std::vector<unsigned int> counts;
+        std::vector<unsigned int> triangles;
+
+        Adjacency(const std::vector<unsigned int>& indices, size_t vertexCount)
+            : offsets(vertexCount + 1, 0), counts(vertexCount, 0), triangles(indices.size())
+        {
+            for(size_t i=0; i<indices.size(); ++i)
+                ++counts[indices[i]];
+            for(size_t v=0; v<vertexCount; ++v)
+                offsets[v+1] = offsets[v] + counts[v];
+            std::fill(counts.begin(), counts.end(), 0);
+            for(size_t i=0; i<indices.size(); ++i){
+                unsigned int v = indices[i];
+                triangles[offsets[v] + counts[v]++] = (unsigned int)(i / 3);
+            }
+        }
+    };
+
+    /* Area weighted normal and centroid of a triangle, with the area as
+       the length of the normal */
+    inline void triangleGeometry(const IndexedMesh& mesh, const std::vector<unsigned int>& indices,
+                                 size_t triangle, Vector3f& normal, Vector3f& centroid)
+    {
+        const Vector4f& a = mesh.vertices[indices[triangle*3+0]];
+        const Vector4f& b = mesh.vertices[indices[triangle*3+1]];
+        const Vector4f& c = mesh.vertices[indices[triangle*3+2]];
+        Vector3f p0(a.x, a.y, a.z), p1(b.x, b.y, b.z), p2(c.x, c.y, c.z);
+        normal = cross(p1 - p0, p2 - p0);
+        centroid = (p0 + p1 + p2) / 3.0f;
+    }
+
+    struct Cluster
+    {
+        size_t first;
+        size_t count;
+        float sortKey;
+        bool operator<(const Cluster& c) const
+        {
+            return sortKey > c.sortKey;
+        }
+    };
+
+    /* Misses when the triangles in [first, last) go through a FIFO cache
+       that starts out empty */
+    struct FifoCache
+    {
+        std::vector<unsigned int> stamps;
+        unsigned int time;
+        unsigned int size;
+
+        FifoCache(size_t vertexCount, unsigned int cacheSize)
+            : stamps(vertexCount, 0), time(cacheSize + 1), size(cacheSize){}
+
+        void flush()
+        {
+            time += size + 1;
+        }
+
+        unsigned int fetch(unsigned int v)
+        {
+            if(time - stamps[v] > size){
+                stamps[v] = time++;
+                return 1;
+            }
+            return 0;
+        }
+    };
+
+    /* Rasterizes one triangle at pixel centers into a float depth buffer
+       and counts the pixels that pass the depth test */
+    inline unsigned int rasterizeDepth(std::vector<float>& depth, int size,
+                                       const Vector3f& a, const Vector3f& b, const Vector3f& c)
+    {
+        float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+        if(area == 0.0f)
+            return 0;
+
+        int minX = std::max(0, (int)std::floor(std::min(a.x, std::min(b.x, c.x))));
+        int minY = std::max(0, (int)std::floor(std::min(a.y, std::min(b.y, c.y))));
+        int maxX = std::min(size - 1, (int)std::ceil(std::max(a.x, std::max(b.x, c.x))));
+        int maxY = std::min(size - 1, (int)std::ceil(std::max(a.y, std::max(b.y, c.y))));
+        float invArea = 1.0f / area;
+        unsigned int shaded = 0;
+
+        for(int y=minY; y<=maxY; ++y){
+            for(int x=minX; x<=maxX; ++x){
+                float px = x + 0.5f, py = y + 0.5f;
+                float w0 = ((b.x - px) * (c.y - py) - (b.y - py) * (c.x - px)) * invArea;
+                float w1 = ((c.x - px) * (a.y - py) - (c.y - py) * (a.x - px)) * invArea;
+                float w2 = 1.0f - w0 - w1;
+                if(w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                    continue;
+                float z = w0 * a.z + w1 * b.z + w2 * c.z;
+                float& dst = depth[y*size + x];
+                if(z < dst){
+                    dst = z;
+                    ++shaded;
+                }
+            }
+        }
+        return shaded;
+    }
+}
+
+/* Average cache miss ratio (misses per triangle, 0.5 is about the best a
+   regular grid can do and 3 the worst) and average transform to vertex
+   ratio (misses per unique vertex, 1 is ideal) for a FIFO cache */
+inline void analyzeVertexCache(const IndexedMesh& mesh, float& acmr, float& atvr,
+                               unsigned int cacheSize = MESH_FIFO_CACHE_SIZE)
+{
+    meshopt_detail::FifoCache cache(mesh.vertices.size(), cacheSize);
+    size_t count = mesh.indexCount();
+    unsigned int misses = 0;
+
+    for(size_t i=0; i<count; ++i)
+        misses += cache.fetch(mesh.index(i));
+    acmr = count ? misses / (count / 3.0f) : 0.0f;
+    atvr = mesh.vertices.empty() ? 0.0f : misses / (float)mesh.vertices.size();
+}
+
+/* Pixels shaded per pixel covered, with the mesh drawn in index order from
+   the six axis directions. Front and back faces are counted in separate
+   depth buffers, so the result does not depend on the winding. 1 means
+   every visible pixel was only shaded once. */
+inline float analyzeOverdraw(const IndexedMesh& mesh)
+{
+    const int size = 256;
+    std::vector<unsigned int> indices;
+    meshopt_detail::getIndices(mesh, indices);
+    if(indices.empty())
+        return 0.0f;
+
+    Vector3f lo(FLT_MAX, FLT_MAX, FLT_MAX), hi(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for(size_t i=0; i<mesh.vertices.size(); ++i){
+        const Vector4f& v = mesh.vertices[i];
+        lo = Vector3f(std::min(lo.x, v.x), std::min(lo.y, v.y), std::min(lo.z, v.z));
+        hi = Vector3f(std::max(hi.x, v.x), std::max(hi.y, v.y), std::max(hi.z, v.z));
+    }
+    float extent = std::max(hi.x - lo.x, std::max(hi.y - lo.y, hi.z - lo.z));
+    float scale = extent > 0.0f ? (size - 1) / extent : 0.0f;
+
+    unsigned long long shaded = 0, covered = 0;
+    std::vector<float> depth[2];
+    std::vector<Vector3f> points(mesh.vertices.size());
+
+    for(int axis=0; axis<3; ++axis){
+        for(int flip=0; flip<2; ++flip){
+            /* Screen x, screen y and depth, as a right-handed view looking
+               down the axis from either side */
+            for(size_t i=0; i<mesh.vertices.size(); ++i){
+                const Vector4f& v = mesh.vertices[i];
+                float p[3] = { (v.x - lo.x) * scale, (v.y - lo.y) * scale, (v.z - lo.z) * scale };
+                float sx = p[(axis + 1) % 3], sy = p[(axis + 2) % 3], sz = p[axis];
+                points[i] = flip ? Vector3f(sy, sx, sz) : Vector3f(sx, sy, -sz);
+            }
+            for(int side=0; side<2; ++side)
+                depth[side].assign(size * size, FLT_MAX);
+
+            for(size_t t=0; t<indices.size(); t+=3){
+                const Vector3f& a = points[indices[t]];
+                const Vector3f& b = points[indices[t+1]];
+                const Vector3f& c = points[indices[t+2]];
+                float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+                shaded += meshopt_detail::rasterizeDepth(depth[area < 0.0f], size, a, b, c);
+            }
+            for(int side=0; side<2; ++side)
+                for(size_t i=0; i<depth[side].size(); ++i)
+                    covered += depth[side][i] != FLT_MAX;
+        }
+    }
+    return covered ? (float)((double)shaded / (double)covered) : 0.0f;
+}
+
+/* Reorders the triangles for the post-transform vertex cache */
+inline void optimizeVertexCache(IndexedMesh& mesh)
+{
+    using namespace meshopt_detail;
+    std::vector<unsigned int> indices;
+    getIndices(mesh, indices);
+    size_t triangleCount = indices.size() / 3;
+    size_t vertexCount = mesh.vertices.size();
+    if(!triangleCount)
+        return;
+
+    Adjacency adjacency(indices, vertexCount);
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    std::vector<float> triangleScores(triangleCount, 0.0f);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<unsigned int> output;
+    std::vector<unsigned int> cache, nextCache;
+    output.reserve(indices.size());
+    cache.reserve(kCacheSize + 3);
+    nextCache.reserve(kCacheSize + 3);
+
+    for(size_t v=0; v<vertexCount; ++v)
+        vertexScores[v] = vertexScore(-1, adjacency.counts[v]);
+    for(size_t t=0; t<triangleCount; ++t)
+        triangleScores[t] = vertexScores[indices[t*3]] + vertexScores[indices[t*3+1]] + vertexScores[indices[t*3+2]];
+
+    size_t best = std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin();
+    size_t cursor = 0;
+
+    for(size_t n=0; n<triangleCount; ++n){
+        /* Nothing left around the cache, so start over on the first
+           triangle that has not been emitted */
+        if(best == (size_t)-1){
+            while(emitted[cursor])
+                ++cursor;
+            best = cursor;
+        }
+
+        emitted[best] = true;
+        const unsigned int* tri = &indices[best*3];
+        output.insert(output.end(), tri, tri + 3);
+
+        /* Take the triangle out of the live triangles of its vertices */
+        for(int k=0; k<3; ++k){
+            unsigned int v = tri[k];
+            unsigned int* live = &adjacency.triangles[adjacency.offsets[v]];
+            unsigned int count = adjacency.counts[v];
+            for(unsigned int i=0; i<count; ++i){
+                if(live[i] == best){
+                    live[i] = live[count - 1];
+                    break;
+                }
+            }
+            --adjacency.counts[v];
+        }
+
+        /* The triangle's vertices move to the front of the LRU cache */
+        nextCache.assign(tri, tri + 3);
+        for(size_t i=0; i<cache.size(); ++i)
+            if(cache[i] != tri[0] && cache[i] != tri[1] && cache[i] != tri[2])
+                nextCache.push_back(cache[i]);
+        cache.swap(nextCache);
+
+        for(size_t i=0; i<cache.size(); ++i){
+            unsigned int v = cache[i];
+            cachePosition[v] = i < (size_t)kCacheSize ? (int)i : -1;
+            vertexScores[v] = vertexScore(cachePosition[v], adjacency.counts[v]);
+        }
+
+        /* Only triangles around the cache changed score, and the next one
+           is picked among them */
+        best = (size_t)-1;
+        float bestScore = -1.0f;
+        for(size_t i=0; i<cache.size(); ++i){
+            unsigned int v = cache[i];
+            const unsigned int* live = &adjacency.triangles[adjacency.offsets[v]];
+            for(unsigned int j=0; j<adjacency.counts[v]; ++j){
+                unsigned int t = live[j];
+                float score = vertexScores[indices[t*3]] + vertexScores[indices[t*3+1]] + vertexScores[indices[t*3+2]];
+                triangleScores[t] = score;
+                if(score > bestScore){
+                    bestScore = score;
+                    best = t;
+                }
+            }
+        }
+        /* Vertices pushed out of the cache are no longer tracked */
+        if(cache.size() > (size_t)kCacheSize)
+            cache.resize(kCacheSize);
+    }
+
+    setIndices(mesh, output);
+}
+
+/* Sorts clusters of the triangle order so the ones facing away from the
+   center of the mesh come first, which tends to draw front to back from
+   any direction. The clusters are cut where the FIFO cache would restart
+   anyway, and further where their own ACMR stays within threshold of the
+   cache-optimized order, so the vertex cache loses little. Run this after
+   optimizeVertexCache. */
+inline void optimizeOverdraw(IndexedMesh& mesh, float threshold = 1.05f)
+{
+    using namespace meshopt_detail;
+    std::vector<unsigned int> indices;
+    getIndices(mesh, indices);
+    size_t triangleCount = indices.size() / 3;
+    if(triangleCount < 2)
+        return;
+
+    /* Hard boundaries, where a triangle misses on all three vertices */
+    std::vector<size_t> hard;
+    FifoCache cache(mesh.vertices.size(), MESH_FIFO_CACHE_SIZE);
+    for(size_t t=0; t<triangleCount; ++t){
+        unsigned int misses = cache.fetch(indices[t*3]) + cache.fetch(indices[t*3+1]) + cache.fetch(indices[t*3+2]);
+        if(misses == 3 || t == 0)
+            hard.push_back(t);
+    }
+    hard.push_back(triangleCount);
+
+    /* Soft boundaries inside each, once the cluster so far is about as
+       cache friendly as the whole run */
+    std::vector<Cluster> clusters;
+    for(size_t h=0; h+1<hard.size(); ++h){
+        size_t first = hard[h], last = hard[h+1];
+        unsigned int runMisses = 0;
+        cache.flush();
+        for(size_t t=first; t<last; ++t)
+            runMisses += cache.fetch(indices[t*3]) + cache.fetch(indices[t*3+1]) + cache.fetch(indices[t*3+2]);
+        float runAcmr = runMisses / (float)(last - first);
+
+        unsigned int misses = 0;
+        size_t start = first;
+        cache.flush();
+        for(size_t t=first; t<last; ++t){
+            misses += cache.fetch(indices[t*3]) + cache.fetch(indices[t*3+1]) + cache.fetch(indices[t*3+2]);
+            size_t count = t + 1 - start;
+            if(t + 1 < last && misses <= runAcmr * threshold * count){
+                Cluster cluster = { start, count, 0.0f };
+                clusters.push_back(cluster);
+                start = t + 1;
+                misses = 0;
+                cache.flush();
+            }
+        }
+        Cluster cluster = { start, last - start, 0.0f };
+        clusters.push_back(cluster);
+    }
+
+    Vector3f meshCentroid;
+    float meshArea = 0.0f;
+    for(size_t t=0; t<triangleCount; ++t){
+        Vector3f normal, centroid;
+        triangleGeometry(mesh, indices, t, normal, centroid);
+        float area = std::sqrt(dot(normal, normal));
+        meshCentroid += centroid * area;
+        meshArea += area;
+    }
+    if(meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    for(size_t c=0; c<clusters.size(); ++c){
+        Vector3f clusterNormal, clusterCentroid;
+        float clusterArea = 0.0f;
+        for(size_t t=clusters[c].first; t<clusters[c].first + clusters[c].count; ++t){
+            Vector3f normal, centroid;
+            triangleGeometry(mesh, indices, t, normal, centroid);
+            float area = std::sqrt(dot(normal, normal));
+            clusterNormal += normal;
+            clusterCentroid += centroid * area;
+            clusterArea += area;
+        }
+        if(clusterArea > 0.0f)
+            clusterCentroid /= clusterArea;
+        float length = std::sqrt(dot(clusterNormal, clusterNormal));
+        if(length > 0.0f)
+            clusterNormal /= length;
+        clusters[c].sortKey = dot(clusterCentroid - meshCentroid, clusterNormal);
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end());
+
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+    for(size_t c=0; c<clusters.size(); ++c){
+        const unsigned int* src = &indices[clusters[c].first * 3];
+        output.insert(output.end(), src, src + clusters[c].count * 3);
+    }
+    setIndices(mesh, output);
+}
+
+/* Renumbers the vertices in the order the triangles first use them, so
+   gathering them walks the vertex buffer mostly forwards. Vertices no
+   triangle uses are dropped. */
+inline void optimizeVertexFetch(IndexedMesh& mesh)
+{
+    std::vector<unsigned int> indices;
+    meshopt_detail::getIndices(mesh, indices);
+    std::vector<unsigned int> remap(mesh.vertices.size(), ~0u);
+    std::vector<Vector4f> vertices, tcoords;
+    bool textured = !mesh.tcoords.empty();
+    vertices.reserve(mesh.vertices.size());
+    tcoords.reserve(mesh.tcoords.size());
+
+    for(size_t i=0; i<indices.size(); ++i){
+        unsigned int& index = remap[indices[i]];
+        if(index == ~0u){
+            index = (unsigned int)vertices.size();
+            vertices.push_back(mesh.vertices[indices[i]]);
+            if(textured)
+                tcoords.push_back(mesh.tcoords[indices[i]]);
+        }
+        indices[i] = index;
+    }
+
+    mesh.vertices.swap(vertices);
+    mesh.tcoords.swap(tcoords);
+    meshopt_detail::setIndices(mesh, indices);
+}
+
+/* Runs all three passes. With a name, the cache and overdraw numbers
+   before and after are printed under it. */
+inline void optimizeMesh(IndexedMesh& mesh, bool overdraw = true, const char* name = NULL)
+{
+    float acmr, atvr, overdrawRatio = 0.0f;
+    if(name){
+        analyzeVertexCache(mesh, acmr, atvr);
+        overdrawRatio = analyzeOverdraw(mesh);
+        printf("%s: %u triangles, %u vertices\n", name,
+               (unsigned int)(mesh.indexCount() / 3), (unsigned int)mesh.vertices.size());
+        printf("  before: ACMR %.3f, ATVR %.3f, overdraw %.3f\n", acmr, atvr, overdrawRatio);
+    }
+
+    optimizeVertexCache(mesh);
+    if(overdraw)
+        optimizeOverdraw(mesh);
+    optimizeVertexFetch(mesh);
+
+    if(name){
+        analyzeVertexCache(mesh, acmr, atvr);
+        overdrawRatio = analyzeOverdraw(mesh);
+        printf("  after:  ACMR %.3f, ATVR %.3f, overdraw %.3f\n", acmr, atvr, overdrawRatio);
+    }
+}
+
+#endif
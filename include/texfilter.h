@@ -0,0 +1,120 @@
+/*
+Copyright (c) 2013, Mads Andreas Elvheim
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+*/
+
+#ifndef TEXFILTER_H_GUARD
+#define TEXFILTER_H_GUARD
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Bilinear blend of four 32-bit texels, all four 8-bit channels at once.
+   t00 and t01 are neighbours along s, t10 and t11 the row below. fs and
+   ft are the fractions in [0,255], the top 8 bits of the Q16 fraction.
+
+   Both passes are a + (b - a) * f done as (a*(256 - f) + b*f) >> 8, which
+   stays within 16 bits. The SSE2 and scalar versions round the same way,
+   so the result doesn't depend on the build. */
+#if defined(__SSE2__)
+
+inline unsigned int BilinearBlend(unsigned int t00, unsigned int t01,
+                                  unsigned int t10, unsigned int t11,
+                                  unsigned int fs, unsigned int ft)
+{
+    const __m128i zero = _mm_setzero_si128();
+    /* One 16-bit lane per channel, s neighbours in the low and high halves */
+    __m128i row0 = _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128(t00), _mm_cvtsi32_si128(t01)), zero);
+    __m128i row1 = _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128(t10), _mm_cvtsi32_si128(t11)), zero);
+
+    __m128i wt = _mm_set1_epi16((short)ft);
+    __m128i column = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(row0, _mm_sub_epi16(_mm_set1_epi16(256), wt)),
+                                                  _mm_mullo_epi16(row1, wt)), 8);
+
+    __m128i ws = _mm_set_epi16((short)fs, (short)fs, (short)fs, (short)fs,
+                               (short)(256 - fs), (short)(256 - fs), (short)(256 - fs), (short)(256 - fs));
+    __m128i weighted = _mm_mullo_epi16(column, ws);
+    __m128i sum = _mm_srli_epi16(_mm_add_epi16(weighted, _mm_srli_si128(weighted, 8)), 8);
+    return (unsigned int)_mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+}
+
+#else
+
+inline unsigned int BilinearBlend(unsigned int t00, unsigned int t01,
+                                  unsigned int t10, unsigned int t11,
+                                  unsigned int fs, unsigned int ft)
+{
+    unsigned int result = 0;
+    for(int shift=0; shift<32; shift+=8){
+        unsigned int a = (((t00 >> shift) & 255) * (256 - ft) + ((t10 >> shift) & 255) * ft) >> 8;
+        unsigned int b = (((t01 >> shift) & 255) * (256 - ft) + ((t11 >> shift) & 255) * ft) >> 8;
+        result |= ((a * (256 - fs) + b * fs) >> 8) << shift;
+    }
+    return result;
+}
+
+#endif
+
+#if defined(__SSE2__)
+
+/* BilinearBlend for four pixels, one per 32-bit lane of each argument.
+   fs and ft hold one fraction per lane. */
+inline __m128i BilinearBlend4(__m128i t00, __m128i t01, __m128i t10, __m128i t11,
+                              __m128i fs, __m128i ft)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(256);
+    /* Fractions copied to the four 16-bit channel lanes of their pixel */
+    fs = _mm_or_si128(fs, _mm_slli_epi32(fs, 16));
+    ft = _mm_or_si128(ft, _mm_slli_epi32(ft, 16));
+
+    __m128i wsLo = _mm_unpacklo_epi32(fs, fs), wsHi = _mm_unpackhi_epi32(fs, fs);
+    __m128i wtLo = _mm_unpacklo_epi32(ft, ft), wtHi = _mm_unpackhi_epi32(ft, ft);
+#define LERP(a, b, w) _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(a, _mm_sub_epi16(one, w)), \
+                                                   _mm_mullo_epi16(b, w)), 8)
+    __m128i lo = LERP(LERP(_mm_unpacklo_epi8(t00, zero), _mm_unpacklo_epi8(t10, zero), wtLo),
+                      LERP(_mm_unpacklo_epi8(t01, zero), _mm_unpacklo_epi8(t11, zero), wtLo), wsLo);
+    __m128i hi = LERP(LERP(_mm_unpackhi_epi8(t00, zero), _mm_unpackhi_epi8(t10, zero), wtHi),
+                      LERP(_mm_unpackhi_epi8(t01, zero), _mm_unpackhi_epi8(t11, zero), wtHi), wsHi);
+#undef LERP
+    return _mm_packus_epi16(lo, hi);
+}
+
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+/* BilinearBlend for eight pixels */
+inline __m256i BilinearBlend8(__m256i t00, __m256i t01, __m256i t10, __m256i t11,
+                              __m256i fs, __m256i ft)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi16(256);
+    fs = _mm256_or_si256(fs, _mm256_slli_epi32(fs, 16));
+    ft = _mm256_or_si256(ft, _mm256_slli_epi32(ft, 16));
+
+    /* The unpacks work within each 128-bit half, and the pack at the end
+       puts every pixel back in its own lane */
+    __m256i wsLo = _mm256_unpacklo_epi32(fs, fs), wsHi = _mm256_unpackhi_epi32(fs, fs);
+    __m256i wtLo = _mm256_unpacklo_epi32(ft, ft), wtHi = _mm256_unpackhi_epi32(ft, ft);
+#define LERP(a, b, w) _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(a, _mm256_sub_epi16(one, w)), \
+                                                         _mm256_mullo_epi16(b, w)), 8)
+    __m256i lo = LERP(LERP(_mm256_unpacklo_epi8(t00, zero), _mm256_unpacklo_epi8(t10, zero), wtLo),
+                      LERP(_mm256_unpacklo_epi8(t01, zero), _mm256_unpacklo_epi8(t11, zero), wtLo), wsLo);
+    __m256i hi = LERP(LERP(_mm256_unpackhi_epi8(t00, zero), _mm256_unpackhi_epi8(t10, zero), wtHi),
+                      LERP(_mm256_unpackhi_epi8(t01, zero), _mm256_unpackhi_epi8(t11, zero), wtHi), wsHi);
+#undef LERP
+    return _mm256_packus_epi16(lo, hi);
+}
+
+#endif
+
+#endif
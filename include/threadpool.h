@@ -0,0 +1,123 @@
+/*
+Copyright (c) 2013, Mads Andreas Elvheim
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+*/
+
+#ifndef THREADPOOL_H_GUARD
+#define THREADPOOL_H_GUARD
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <algorithm>
+
+/* A fixed set of worker threads pulling jobs from a shared queue.
+   The pool is created once and reused every frame, so the cost of
+   spawning threads is never paid inside the render loop. */
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned int threadCount) : stopping(false)
+    {
+        if(!threadCount)
+            threadCount = 1;
+        for(unsigned int i=0; i<threadCount; ++i)
+            workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueCondition.notify_all();
+        for(size_t i=0; i<workers.size(); ++i)
+            workers[i].join();
+    }
+
+    unsigned int size() const
+    {
+        return workers.size();
+    }
+
+    void enqueue(const std::function<void()>& job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            jobs.push_back(job);
+        }
+        queueCondition.notify_one();
+    }
+
+    /* Calls func(i) for every i in [0, count). The indices are handed out
+       dynamically, so uneven jobs still balance. The calling thread helps
+       out and the function returns when every index is done. */
+    template<class F> void parallelFor(unsigned int count, F func)
+    {
+        if(!count)
+            return;
+
+        std::atomic<unsigned int> next(0);
+        unsigned int helpers = std::min<unsigned int>(workers.size(), count - 1);
+        unsigned int exited = 0;
+        std::mutex exitMutex;
+        std::condition_variable exitCondition;
+
+        auto work = [&]()
+        {
+            for(unsigned int i = next++; i < count; i = next++)
+                func(i);
+        };
+        /* Helpers reference this stack frame, so we can't return before
+           every one of them has left, even those that found no work. */
+        auto helper = [&]()
+        {
+            work();
+            std::lock_guard<std::mutex> lock(exitMutex);
+            ++exited;
+            exitCondition.notify_all();
+        };
+
+        for(unsigned int i=0; i<helpers; ++i)
+            enqueue(helper);
+        work();
+
+        std::unique_lock<std::mutex> lock(exitMutex);
+        exitCondition.wait(lock, [&](){ return exited == helpers; });
+    }
+
+private:
+    void workerLoop()
+    {
+        for(;;){
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueCondition.wait(lock, [this](){ return stopping || !jobs.empty(); });
+                if(stopping && jobs.empty())
+                    return;
+                job = jobs.front();
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::deque< std::function<void()> > jobs;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    bool stopping;
+};
+
+#endif
@@ -0,0 +1,314 @@
+/*
+Copyright (c) 2013, Mads Andreas Elvheim
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+*/
+
+#ifndef VERTEXSTREAM_H_GUARD
+#define VERTEXSTREAM_H_GUARD
+#include <vector>
+#include <cstddef>
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define VERTEXSTREAM_SSE
+#endif
+#include "linealg.h"
+
+/* Vertex positions stored as a structure of arrays. Every component has
+   its own array, so one SIMD load fetches the same component of 4 (SSE)
+   or 8 (AVX) consecutive vertices, and the matrix is applied to all of
+   them at once. */
+struct VertexStream
+{
+    std::vector<float> x, y, z, w;
+
+    size_t size() const
+    {
+        return x.size();
+    }
+
+    void resize(size_t count)
+    {
+        x.resize(count);
+        y.resize(count);
+        z.resize(count);
+        w.resize(count);
+    }
+
+    Vector4f get(size_t i) const
+    {
+        return Vector4f(x[i], y[i], z[i], w[i]);
+    }
+
+    void set(size_t i, const Vector4f& v)
+    {
+        x[i] = v.x; y[i] = v.y; z[i] = v.z; w[i] = v.w;
+    }
+};
+
+inline void toVertexStream(const std::vector<Vector4f>& src, VertexStream& dst)
+{
+    dst.resize(src.size());
+    for(size_t i=0; i<src.size(); ++i)
+        dst.set(i, src[i]);
+}
+
+inline void fromVertexStream(const VertexStream& src, std::vector<Vector4f>& dst)
+{
+    dst.resize(src.size());
+    for(size_t i=0; i<src.size(); ++i)
+        dst[i] = src.get(i);
+}
+
+/* Outcode bits, one per frustum plane in clipping order. A bit is set
+   when the clip space vertex is outside or exactly on that plane, which
+   is the same test the clipper uses. The guard band bits test the same
+   x and y planes pushed out by the guard band scale. */
+enum Outcode {
+    OUTCODE_POS_X = 1,  /* x >=  w */
+    OUTCODE_NEG_X = 2,  /* x <= -w */
+    OUTCODE_NEG_Y = 4,  /* y <= -w */
+    OUTCODE_POS_Y = 8,  /* y >=  w */
+    OUTCODE_POS_Z = 16, /* z >=  w */
+    OUTCODE_NEG_Z = 32, /* z <= -w */
+    OUTCODE_GUARD_POS_X = 64,  /* x >=  w*scaleX */
+    OUTCODE_GUARD_NEG_X = 128, /* x <= -w*scaleX */
+    OUTCODE_GUARD_NEG_Y = 256, /* y <= -w*scaleY */
+    OUTCODE_GUARD_POS_Y = 512  /* y >=  w*scaleY */
+};
+#define OUTCODE_FRUSTUM 63
+#define OUTCODE_GUARD   960
+
+/* A band of 'pixels' around the viewport where geometry is rasterized
+   and scissored instead of clipped. scaleX and scaleY place the guard
+   band planes in clip space: x = w*scaleX is the right edge of the band.
+   The default is no guard band, where the band planes are the frustum. */
+struct GuardBand
+{
+    float pixels;
+    float scaleX, scaleY;
+    GuardBand() : pixels(0.0f), scaleX(1.0f), scaleY(1.0f){}
+    GuardBand(float guardPixels, float width, float height) :
+        pixels(guardPixels),
+        scaleX(1.0f + guardPixels / (width*0.5f)),
+        scaleY(1.0f + guardPixels / (height*0.5f)){}
+};
+
+/* The per-vertex work, written once for every register width. R is float
+   for the scalar tail, __m128 for SSE and __m256 for AVX. The operations
+   are done in the same order as operator*(Matrix4, Vector4) and project(),
+   so every path gives bit-identical results. */
+namespace vertexstream_detail
+{
+    struct ScalarOps
+    {
+        typedef float R;
+        static const size_t width = 1;
+        static R load(const float* p){ return *p; }
+        static void store(float* p, R v){ *p = v; }
+        static R set1(float f){ return f; }
+        static R add(R a, R b){ return a + b; }
+        static R sub(R a, R b){ return a - b; }
+        static int outsideMask(R v){ return !(v > 0.0f); }
+        static R mul(R a, R b){ return a * b; }
+        static R div(R a, R b){ return a / b; }
+        static R clampRange(R v, R mn, R mx){ return clamp(v, mn, mx); }
+    };
+
+#if defined(__AVX__)
+    struct SimdOps
+    {
+        typedef __m256 R;
+        static const size_t width = 8;
+        static R load(const float* p){ return _mm256_loadu_ps(p); }
+        static void store(float* p, R v){ _mm256_storeu_ps(p, v); }
+        static R set1(float f){ return _mm256_set1_ps(f); }
+        static R add(R a, R b){ return _mm256_add_ps(a, b); }
+        static R sub(R a, R b){ return _mm256_sub_ps(a, b); }
+        static int outsideMask(R v){ return _mm256_movemask_ps(_mm256_cmp_ps(v, _mm256_setzero_ps(), _CMP_NGT_UQ)); }
+        static R mul(R a, R b){ return _mm256_mul_ps(a, b); }
+        static R div(R a, R b){ return _mm256_div_ps(a, b); }
+        static R clampRange(R v, R mn, R mx){ return _mm256_min_ps(_mm256_max_ps(v, mn), mx); }
+    };
+#elif defined(VERTEXSTREAM_SSE)
+    struct SimdOps
+    {
+        typedef __m128 R;
+        static const size_t width = 4;
+        static R load(const float* p){ return _mm_loadu_ps(p); }
+        static void store(float* p, R v){ _mm_storeu_ps(p, v); }
+        static R set1(float f){ return _mm_set1_ps(f); }
+        static R add(R a, R b){ return _mm_add_ps(a, b); }
+        static R sub(R a, R b){ return _mm_sub_ps(a, b); }
+        static int outsideMask(R v){ return _mm_movemask_ps(_mm_cmpngt_ps(v, _mm_setzero_ps())); }
+        static R mul(R a, R b){ return _mm_mul_ps(a, b); }
+        static R div(R a, R b){ return _mm_div_ps(a, b); }
+        static R clampRange(R v, R mn, R mx){ return _mm_min_ps(_mm_max_ps(v, mn), mx); }
+    };
+#else
+    typedef ScalarOps SimdOps;
+#endif
+
+    struct Viewport
+    {
+        float centerX, centerY;
+        float width, height;
+        GuardBand guard;
+        Viewport(float w, float h, const GuardBand& g = GuardBand()) :
+            centerX(w*0.5f), centerY(h*0.5f), width(w), height(h), guard(g){}
+    };
+
+    template<class Ops>
+    inline void transformRow(const Matrix4f& m, typename Ops::R& x, typename Ops::R& y,
+                             typename Ops::R& z, typename Ops::R& w)
+    {
+        typedef typename Ops::R R;
+        R r[4];
+        for(int row=0; row<4; ++row){
+            const float* c = &m.m[row*4];
+            r[row] = Ops::add(Ops::add(Ops::add(Ops::mul(x, Ops::set1(c[0])),
+                                                Ops::mul(y, Ops::set1(c[1]))),
+                                       Ops::mul(z, Ops::set1(c[2]))),
+                              Ops::mul(w, Ops::set1(c[3])));
+        }
+        x = r[0]; y = r[1]; z = r[2]; w = r[3];
+    }
+
+    /* Perspective divide followed by the viewport mapping of project().
+       x, y and z are divided by w like Vector3::operator/, rather than
+       multiplied by 1/w, which can differ in the last bit. w is replaced
+       by 1/w, which is what the rasterizer interpolates. */
+    template<class Ops>
+    inline void projectRow(const Viewport& vp, typename Ops::R& x, typename Ops::R& y,
+                           typename Ops::R& z, typename Ops::R& w)
+    {
+        typedef typename Ops::R R;
+        R wInv = Ops::div(Ops::set1(1.0f), w);
+        R cx = Ops::set1(vp.centerX);
+        R cy = Ops::set1(vp.centerY);
+        R half = Ops::set1(0.5f);
+        R lower = Ops::set1(0.0f - vp.guard.pixels);
+        x = Ops::clampRange(Ops::add(Ops::mul(Ops::div(x, w), cx), cx), lower, Ops::set1(vp.width + vp.guard.pixels));
+        y = Ops::clampRange(Ops::add(Ops::mul(Ops::div(y, w), cy), cy), lower, Ops::set1(vp.height + vp.guard.pixels));
+        z = Ops::add(Ops::mul(Ops::div(z, w), half), half);
+        w = wInv;
+    }
+
+    /* One outcode per lane. Each plane test gives a lane mask, which is
+       then spread out into the per-vertex codes. */
+    template<class Ops>
+    inline void outcodeRow(const GuardBand& guard,
+                           typename Ops::R x, typename Ops::R y, typename Ops::R z,
+                           typename Ops::R w, unsigned short* codes)
+    {
+        typedef typename Ops::R R;
+        R wx = Ops::mul(w, Ops::set1(guard.scaleX));
+        R wy = Ops::mul(w, Ops::set1(guard.scaleY));
+        int masks[10] = {
+            Ops::outsideMask(Ops::sub(w, x)),
+            Ops::outsideMask(Ops::add(x, w)),
+            Ops::outsideMask(Ops::add(y, w)),
+            Ops::outsideMask(Ops::sub(w, y)),
+            Ops::outsideMask(Ops::sub(w, z)),
+            Ops::outsideMask(Ops::add(z, w)),
+            Ops::outsideMask(Ops::sub(wx, x)),
+            Ops::outsideMask(Ops::add(x, wx)),
+            Ops::outsideMask(Ops::add(y, wy)),
+            Ops::outsideMask(Ops::sub(wy, y))
+        };
+        for(size_t lane=0; lane<Ops::width; ++lane){
+            unsigned short code = 0;
+            for(int plane=0; plane<10; ++plane)
+                code |= ((masks[plane] >> lane) & 1) << plane;
+            codes[lane] = code;
+        }
+    }
+
+    template<class Ops, bool Transform, bool Project>
+    inline size_t processRange(const Matrix4f& m, const Viewport& vp,
+                               const VertexStream& src, VertexStream& dst,
+                               unsigned short* outcodes, size_t begin, size_t end)
+    {
+        typedef typename Ops::R R;
+        size_t i = begin;
+        for(; i + Ops::width <= end; i += Ops::width){
+            R x = Ops::load(&src.x[i]);
+            R y = Ops::load(&src.y[i]);
+            R z = Ops::load(&src.z[i]);
+            R w = Ops::load(&src.w[i]);
+            if(Transform)
+                transformRow<Ops>(m, x, y, z, w);
+            if(outcodes)
+                outcodeRow<Ops>(vp.guard, x, y, z, w, &outcodes[i]);
+            if(Project)
+                projectRow<Ops>(vp, x, y, z, w);
+            Ops::store(&dst.x[i], x);
+            Ops::store(&dst.y[i], y);
+            Ops::store(&dst.z[i], z);
+            Ops::store(&dst.w[i], w);
+        }
+        return i;
+    }
+
+    template<bool Transform, bool Project>
+    inline void process(const Matrix4f& m, const Viewport& vp,
+                        const VertexStream& src, VertexStream& dst,
+                        unsigned short* outcodes = NULL)
+    {
+        dst.resize(src.size());
+        size_t done = processRange<SimdOps, Transform, Project>(m, vp, src, dst, outcodes, 0, src.size());
+        processRange<ScalarOps, Transform, Project>(m, vp, src, dst, outcodes, done, src.size());
+    }
+}
+
+/* Transforms every vertex in src by m into dst. src and dst may be the
+   same stream. */
+inline void transformStream(const Matrix4f& m, const VertexStream& src, VertexStream& dst)
+{
+    vertexstream_detail::process<true, false>(m, vertexstream_detail::Viewport(0.0f, 0.0f), src, dst);
+}
+
+/* As above, and also stores the clip space outcode of every vertex */
+inline void transformStream(const Matrix4f& m, const VertexStream& src, VertexStream& dst,
+                            std::vector<unsigned short>& outcodes,
+                            const GuardBand& guard = GuardBand())
+{
+    outcodes.resize(src.size());
+    vertexstream_detail::process<true, false>(m, vertexstream_detail::Viewport(0.0f, 0.0f, guard), src, dst,
+                                              outcodes.empty() ? NULL : &outcodes[0]);
+}
+
+/* Outcode of a single clip space vertex */
+inline unsigned short computeOutcode(const Vector4f& v, const GuardBand& guard = GuardBand())
+{
+    unsigned short code;
+    vertexstream_detail::outcodeRow<vertexstream_detail::ScalarOps>(guard, v.x, v.y, v.z, v.w, &code);
+    return code;
+}
+
+/* Takes clip space vertices to screen space: x and y in pixels,
+   z in [0,1] and w = 1/w. Same mapping as project(), x and y are
+   clamped to the viewport grown by the guard band. */
+inline void projectStream(const VertexStream& src, VertexStream& dst, float width, float height,
+                          const GuardBand& guard = GuardBand())
+{
+    Matrix4f unused;
+    vertexstream_detail::process<false, true>(unused, vertexstream_detail::Viewport(width, height, guard), src, dst);
+}
+
+/* transformStream() and projectStream() in a single pass, for vertices
+   that need no clipping in between. */
+inline void transformProjectStream(const Matrix4f& m, const VertexStream& src, VertexStream& dst,
+                                   float width, float height)
+{
+    vertexstream_detail::process<true, true>(m, vertexstream_detail::Viewport(width, height), src, dst);
+}
+
+#endif
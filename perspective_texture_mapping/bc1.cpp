@@ -0,0 +1,154 @@
+#include "bc1.h"
+#include <algorithm>
+
+static unsigned int pack565(const int* c)
+{
+    return ((c[0] >> 3) << 11) | ((c[1] >> 2) << 5) | (c[2] >> 3);
+}
+
+/* Bit replication, so 0 and the largest value map to 0 and 255 */
+static void unpack565(unsigned int v, int* c)
+{
+    int c0 = (v >> 11) & 31, c1 = (v >> 5) & 63, c2 = v & 31;
+    c[0] = (c0 << 3) | (c0 >> 2);
+    c[1] = (c1 << 2) | (c1 >> 4);
+    c[2] = (c2 << 3) | (c2 >> 2);
+}
+
+static unsigned int packTexel(const int* c, unsigned int alpha)
+{
+    return c[0] | (c[1] << 8) | (c[2] << 16) | (alpha << 24);
+}
+
+static void channels(unsigned int texel, int* c)
+{
+    c[0] = texel & 255;
+    c[1] = (texel >> 8) & 255;
+    c[2] = (texel >> 16) & 255;
+}
+
+/* The four palette colors as channel values. Entry 3 is transparent in
+   three color mode, its channels are 0 then. */
+static void palette(unsigned int e0, unsigned int e1, int colors[4][3])
+{
+    unpack565(e0, colors[0]);
+    unpack565(e1, colors[1]);
+    for(int i=0; i<3; ++i){
+        if(e0 > e1){
+            colors[2][i] = (2*colors[0][i] + colors[1][i]) / 3;
+            colors[3][i] = (colors[0][i] + 2*colors[1][i]) / 3;
+        } else {
+            colors[2][i] = (colors[0][i] + colors[1][i]) / 2;
+            colors[3][i] = 0;
+        }
+    }
+}
+
+void DecodeBC1Block(unsigned long long block, unsigned int* texels)
+{
+    unsigned int e0 = block & 0xFFFF;
+    unsigned int e1 = (block >> 16) & 0xFFFF;
+    unsigned int indices = (unsigned int)(block >> 32);
+    int colors[4][3];
+    unsigned int lookup[4];
+
+    palette(e0, e1, colors);
+    for(int i=0; i<4; ++i)
+        lookup[i] = packTexel(colors[i], (e0 <= e1 && i == 3) ? 0 : 255);
+    for(int i=0; i<16; ++i)
+        texels[i] = lookup[(indices >> (2*i)) & 3];
+}
+
+unsigned long long SwapBC1BlockRB(unsigned long long block)
+{
+    unsigned int e0 = block & 0xFFFF;
+    unsigned int e1 = (block >> 16) & 0xFFFF;
+    unsigned int indices = (unsigned int)(block >> 32);
+    bool fourColors = e0 > e1;
+    unsigned int s0 = (e0 & 0x07E0) | (e0 >> 11) | ((e0 & 31) << 11);
+    unsigned int s1 = (e1 & 0x07E0) | (e1 >> 11) | ((e1 & 31) << 11);
+    if(fourColors != (s0 > s1)){
+        std::swap(s0, s1);
+        /* Four colors: 0 and 1 trade places, and so do the two between
+           them. Three colors: only 0 and 1, the average and transparent
+           stay put. */
+        indices ^= fourColors ? 0x55555555 : (~indices >> 1) & 0x55555555;
+    }
+    return s0 | (s1 << 16) | ((unsigned long long)indices << 32);
+}
+
+/* End points from the bounding box of the colors, along the diagonal that
+   follows the correlation of the channels, pulled in by 1/16 of the box
+   so the extremes don't dominate. Texels with alpha below 128 become
+   transparent, which needs three color mode. */
+unsigned long long EncodeBC1Block(const unsigned int* texels)
+{
+    int c[16][3];
+    bool opaque[16];
+    bool transparent = false;
+    int count = 0;
+    int mean[3] = { 0, 0, 0 };
+
+    for(int i=0; i<16; ++i){
+        channels(texels[i], c[i]);
+        opaque[i] = (texels[i] >> 24) >= 128;
+        transparent |= !opaque[i];
+        if(opaque[i]){
+            for(int k=0; k<3; ++k)
+                mean[k] += c[i][k];
+            ++count;
+        }
+    }
+    /* All transparent, and the all-ones block decodes to just that */
+    if(!count)
+        return ~0ULL;
+
+    int lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 };
+    int cov1 = 0, cov2 = 0;
+    for(int i=0; i<16; ++i){
+        if(!opaque[i])
+            continue;
+        for(int k=0; k<3; ++k){
+            lo[k] = std::min(lo[k], c[i][k]);
+            hi[k] = std::max(hi[k], c[i][k]);
+        }
+        int d0 = c[i][0]*count - mean[0];
+        cov1 += d0 * (c[i][1]*count - mean[1]) / 256;
+        cov2 += d0 * (c[i][2]*count - mean[2]) / 256;
+    }
+    if(cov1 < 0)
+        std::swap(lo[1], hi[1]);
+    if(cov2 < 0)
+        std::swap(lo[2], hi[2]);
+    for(int k=0; k<3; ++k){
+        int inset = (hi[k] - lo[k]) / 16;
+        hi[k] -= inset;
+        lo[k] += inset;
+    }
+
+    unsigned int e0 = pack565(hi), e1 = pack565(lo);
+    if(transparent ? e0 > e1 : e0 < e1)
+        std::swap(e0, e1);
+
+    int colors[4][3];
+    palette(e0, e1, colors);
+    int choices = (e0 > e1) ? 4 : 3;
+    unsigned int indices = 0;
+    for(int i=0; i<16; ++i){
+        unsigned int best = 3;
+        if(opaque[i]){
+            int bestError = 1 << 30;
+            for(int j=0; j<choices; ++j){
+                int error = 0;
+                for(int k=0; k<3; ++k)
+                    error += (c[i][k] - colors[j][k]) * (c[i][k] - colors[j][k]);
+                if(error < bestError){
+                    bestError = error;
+                    best = j;
+                }
+            }
+        }
+        indices |= best << (2*i);
+    }
+    return e0 | ((unsigned long long)e1 << 16) | ((unsigned long long)indices << 32);
+}
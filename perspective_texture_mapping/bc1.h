@@ -0,0 +1,70 @@
+/*
+Copyright (c) 2013, Mads Andreas Elvheim
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+*/
+
+#ifndef BC1_H_GUARD
+#define BC1_H_GUARD
+#include <cstring>
+
+/* BC1 (DXT1) blocks. A block is 4x4 texels in 64 bits: two 5:6:5 end
+   point colors in the low 32 bits, then a 2-bit palette index per texel,
+   row by row. When the first end point is larger than the second, the
+   palette is the end points and two colors between them. Otherwise it's
+   the end points, their average and transparent black.
+
+   Bytes 0, 1 and 2 of a texel go into the 5, 6 and 5 bit fields and
+   byte 3 is the alpha, so the byte order of the texture is kept. */
+
+unsigned long long EncodeBC1Block(const unsigned int* texels);
+void DecodeBC1Block(unsigned long long block, unsigned int* texels);
+/* The block with bytes 0 and 2 of its decoded texels swapped, exactly.
+   The 5-bit fields of the end points trade places, and when that turns
+   their order around, so do the end points and their indices, which
+   keeps the palette mode. */
+unsigned long long SwapBC1BlockRB(unsigned long long block);
+
+/* log2 of the number of blocks in the decode cache of each thread */
+#define BC1_CACHE_BITS 8
+
+/* Decoded blocks, direct mapped on the block bits. The decoded texels
+   only depend on those bits, so entries never go stale, whichever
+   texture the block came from. Tags hold the complement of the block,
+   which lets the zeroed cache start out valid: the all-ones block
+   decodes to transparent black everywhere. */
+struct BC1Cache
+{
+    alignas(64) unsigned int texels[1 << BC1_CACHE_BITS][16];
+    unsigned long long tags[1 << BC1_CACHE_BITS];
+    unsigned long long decodes;
+};
+
+/* Zero-initialized, so access doesn't go through a TLS init check */
+inline BC1Cache& ThreadBC1Cache()
+{
+    static thread_local BC1Cache cache;
+    return cache;
+}
+
+/* The decoded texels of the block at 'block', two 32-bit words */
+inline const unsigned int* DecodedBC1Block(const unsigned int* block)
+{
+    unsigned long long bits;
+    std::memcpy(&bits, block, sizeof(bits));
+    BC1Cache& cache = ThreadBC1Cache();
+    unsigned int slot = (unsigned int)((bits * 0x9E3779B97F4A7C15ULL) >> (64 - BC1_CACHE_BITS));
+    if(cache.tags[slot] != ~bits){
+        DecodeBC1Block(bits, cache.texels[slot]);
+        cache.tags[slot] = ~bits;
+        ++cache.decodes;
+    }
+    return cache.texels[slot];
+}
+
+#endif
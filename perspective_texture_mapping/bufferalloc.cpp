@@ -0,0 +1,72 @@
+#include "bufferalloc.h"
+#include <cstdlib>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#define HUGE_PAGE_SIZE (2u << 20)
+
+static BufferAllocFunc bufferAlloc = AllocateAligned;
+static BufferFreeFunc bufferFree = FreeAligned;
+
+void SetBufferAllocator(BufferAllocFunc alloc, BufferFreeFunc release)
+{
+    bufferAlloc = alloc;
+    bufferFree = release;
+}
+
+BufferAllocFunc CurrentBufferAlloc()
+{
+    return bufferAlloc;
+}
+
+BufferFreeFunc CurrentBufferFree()
+{
+    return bufferFree;
+}
+
+static void* allocateAligned(size_t bytes, size_t alignment)
+{
+#if defined(_WIN32)
+    return _aligned_malloc(bytes ? bytes : 1, alignment);
+#else
+    void* data;
+    if(posix_memalign(&data, alignment, bytes ? bytes : 1) != 0)
+        return NULL;
+    return data;
+#endif
+}
+
+void* AllocateAligned(size_t bytes)
+{
+    return allocateAligned(bytes, BUFFER_ALIGNMENT);
+}
+
+void FreeAligned(void* data, size_t bytes)
+{
+    (void)bytes;
+#if defined(_WIN32)
+    _aligned_free(data);
+#else
+    free(data);
+#endif
+}
+
+/* The block is rounded out to whole huge pages, so it doesn't share
+   one with the rest of the heap */
+void* AllocateHugePages(size_t bytes)
+{
+#if defined(MADV_HUGEPAGE)
+    if(bytes >= HUGE_PAGE_SIZE){
+        size_t rounded = (bytes + HUGE_PAGE_SIZE - 1) & ~(size_t)(HUGE_PAGE_SIZE - 1);
+        void* data = allocateAligned(rounded, HUGE_PAGE_SIZE);
+        if(data)
+            madvise(data, rounded, MADV_HUGEPAGE);
+        return data;
+    }
+#endif
+    return AllocateAligned(bytes);
+}
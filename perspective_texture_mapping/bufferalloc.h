@@ -0,0 +1,99 @@
+/*
+Copyright (c) 2013, Mads Andreas Elvheim
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+*/
+
+
+#ifndef BUFFERALLOC_H_GUARD
+#define BUFFERALLOC_H_GUARD
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <limits>
+
+/* Storage of the color, depth and texel buffers. Every block starts on a
+   BUFFER_ALIGNMENT boundary, a cache line, so rows of a Buffer2D with an
+   aligned pitch never straddle one more line than they have to. */
+#define BUFFER_ALIGNMENT 64
+
+typedef void* (*BufferAllocFunc)(size_t bytes);
+typedef void (*BufferFreeFunc)(void* data, size_t bytes);
+
+/* Replaces the functions new buffers are allocated with. Alloc returns
+   NULL on failure and must align to BUFFER_ALIGNMENT. Buffers that exist
+   already keep the pair they were allocated with. */
+void SetBufferAllocator(BufferAllocFunc alloc, BufferFreeFunc release);
+
+/* The default pair, plain aligned heap memory */
+void* AllocateAligned(size_t bytes);
+void FreeAligned(void* data, size_t bytes);
+/* Aligned heap memory that asks for transparent huge pages when the
+   block is at least one huge page, which saves TLB misses on large
+   buffers. Falls back to AllocateAligned where madvise is missing.
+   Free it with FreeAligned. */
+void* AllocateHugePages(size_t bytes);
+
+BufferAllocFunc CurrentBufferAlloc();
+BufferFreeFunc CurrentBufferFree();
+
+/* Standard allocator over the hook, for std::vector. It holds the pair
+   that was current when it was made, and hands it on with the memory
+   when containers are moved, swapped or assigned. */
+template<typename T> struct BufferAllocator
+{
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    BufferAllocator() : alloc(CurrentBufferAlloc()), release(CurrentBufferFree()) {}
+    template<typename U> BufferAllocator(const BufferAllocator<U>& other) : alloc(other.alloc), release(other.release) {}
+
+    T* allocate(size_t n)
+    {
+        if(n > std::numeric_limits<size_t>::max() / sizeof(T))
+            throw std::bad_alloc();
+        void* data = alloc(n * sizeof(T));
+        if(!data)
+            throw std::bad_alloc();
+        return static_cast<T*>(data);
+    }
+    void deallocate(T* data, size_t n) { release(data, n * sizeof(T)); }
+
+    BufferAllocFunc alloc;
+    BufferFreeFunc release;
+};
+
+template<typename T, typename U>
+bool operator==(const BufferAllocator<T>& a, const BufferAllocator<U>& b)
+{
+    return a.alloc == b.alloc && a.release == b.release;
+}
+
+template<typename T, typename U>
+bool operator!=(const BufferAllocator<T>& a, const BufferAllocator<U>& b)
+{
+    return !(a == b);
+}
+
+/* Row pitch in elements for rows of 'width' elements of 'size' bytes.
+   Rows are padded to whole cache lines, and by one more line when that
+   makes the pitch a multiple of 1 KiB. Otherwise a column of a power of
+   two wide buffer maps to only a few cache sets and evicts itself. */
+inline unsigned int BufferPitch(unsigned int width, size_t size)
+{
+    size_t bytes = (width * size + BUFFER_ALIGNMENT - 1) & ~(size_t)(BUFFER_ALIGNMENT - 1);
+    if(bytes && bytes % 1024 == 0)
+        bytes += BUFFER_ALIGNMENT;
+    /* Element sizes that don't divide a cache line keep the packed pitch */
+    if(bytes % size)
+        return width;
+    return (unsigned int)(bytes / size);
+}
+#endif
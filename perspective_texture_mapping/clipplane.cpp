@@ -2,7 +2,9 @@
 #include <algorithm>
 #include <cstdio>
 #include <linealg.h>
+#include <vertexstream.h>
 #include "clipplane.h"
+#include "myassert.h"
 
 void clip_triangle(
 		   std::vector<Vector4f>& vertexList,
@@ -78,3 +80,267 @@ void clip_triangle(
     vertexList.erase(vertexList.begin(), vertexList.begin() + vertexListSize);
     tcoordList.erase(tcoordList.begin(), tcoordList.begin() + vertexListSize);
 }
+
+static unsigned int clipAccepted = 0;
+static unsigned int clipRejected = 0;
+static unsigned int clipClipped = 0;
+static unsigned int trianglesCulled = 0;
+static CullMode cullMode = CULL_NONE;
+
+/* The planes that actually get clipped against. x and y are only
+   clipped at the guard band, the rasterizer scissors the rest */
+#define OUTCODE_CLIP (OUTCODE_GUARD | OUTCODE_POS_Z | OUTCODE_NEG_Z)
+
+int classifyTriangle(unsigned short outcode1, unsigned short outcode2, unsigned short outcode3)
+{
+    /* All three vertices outside the same frustum plane */
+    if(outcode1 & outcode2 & outcode3 & OUTCODE_FRUSTUM)
+	return TRIANGLE_OUTSIDE;
+    if(!((outcode1 | outcode2 | outcode3) & OUTCODE_CLIP))
+	return TRIANGLE_INSIDE;
+    return TRIANGLE_STRADDLING;
+}
+
+int classifyTriangle(const Vector4f& v1, const Vector4f& v2, const Vector4f& v3)
+{
+    return classifyTriangle(computeOutcode(v1), computeOutcode(v2), computeOutcode(v3));
+}
+
+void GetClipStats(unsigned int& accepted, unsigned int& rejected, unsigned int& clipped)
+{
+    accepted = clipAccepted;
+    rejected = clipRejected;
+    clipped = clipClipped;
+    clipAccepted = clipRejected = clipClipped = 0;
+}
+
+void SetCullMode(CullMode mode)
+{
+    cullMode = mode;
+}
+
+unsigned int GetCulledTriangles()
+{
+    unsigned int culled = trianglesCulled;
+    trianglesCulled = 0;
+    return culled;
+}
+
+/* Winding in clip space, before clipping and the divide. The determinant
+   of the (x, y, w) rows has the sign of the screen space area for any
+   sign of w, so triangles crossing the near plane are handled too.
+   Positive is counter-clockwise in normalized device coordinates. */
+static bool culled(const Vector4f& v1, const Vector4f& v2, const Vector4f& v3)
+{
+    if(cullMode == CULL_NONE)
+	return false;
+    float det = v1.x * (v2.y*v3.w - v3.y*v2.w) -
+		v1.y * (v2.x*v3.w - v3.x*v2.w) +
+		v1.w * (v2.x*v3.y - v3.x*v2.y);
+    return cullMode == CULL_BACK ? det <= 0.0f : det >= 0.0f;
+}
+
+/* A triangle clipped against n planes gains at most one vertex per plane */
+#define CLIP_MAX_VERTICES 9
+
+struct ClipPolygon
+{
+    Vector4f vertex[CLIP_MAX_VERTICES];
+    Vector4f tcoord[CLIP_MAX_VERTICES];
+    int count;
+};
+
+/* Outcode bit of each clip plane, in the order the demos used to clip */
+static const unsigned short clipPlaneBits[6] = {
+    OUTCODE_GUARD_POS_X, OUTCODE_GUARD_NEG_X,
+    OUTCODE_GUARD_NEG_Y, OUTCODE_GUARD_POS_Y,
+    OUTCODE_POS_Z, OUTCODE_NEG_Z
+};
+
+/* The bound above holds for a convex clip, which float sign tests only
+   approximate. A polygon that is full anyway drops further vertices
+   rather than overrunning the arrays. */
+static void add_vertex(ClipPolygon& polygon, const Vector4f& vertex, const Vector4f& tcoord)
+{
+    ASSERT(polygon.count < CLIP_MAX_VERTICES);
+    if(polygon.count == CLIP_MAX_VERTICES)
+	return;
+    polygon.vertex[polygon.count] = vertex;
+    polygon.tcoord[polygon.count] = tcoord;
+    ++polygon.count;
+}
+
+/* One Sutherland-Hodgman step. Same edge math as clip_triangle, but on a
+   whole polygon and with fixed size storage */
+static void clip_polygon(const ClipPolygon& in, ClipPolygon& out, const Vector4f& plane)
+{
+    out.count = 0;
+    for(int edge0=in.count-1, edge1=0; edge1 < in.count; edge0 = edge1++){
+	Vector4f point_current = in.vertex[edge0];
+	Vector4f point_next = in.vertex[edge1];
+	Vector4f tcoord_current = in.tcoord[edge0];
+	Vector4f tcoord_next = in.tcoord[edge1];
+	float dot0 = dot(point_current, plane) + point_current.w * plane.w;
+	float dot1 = dot(point_next,    plane) + point_next.w    * plane.w;
+
+	bool inside0 = dot0 > 0.0f;
+	bool inside1 = dot1 > 0.0f;
+
+	if(inside0)
+	    add_vertex(out, point_current, tcoord_current);
+	if(inside0 != inside1){
+	    float t=0.0f;
+	    float diff = 0.0f;
+	    if(inside0 == false){
+		std::swap(point_current, point_next);
+		std::swap(tcoord_current, tcoord_next);
+		std::swap(dot0, dot1);
+	    }
+	    diff = dot0 - dot1;
+	    if(std::abs(diff) > 1e-7f)
+		t = dot0 / diff;
+	    if(std::abs(t) < 0.001f) t = 0.0f;
+	    Vector4f clipPoint = point_current + (point_next - point_current) * t;
+	    clipPoint.w = point_current.w +  (point_next.w - point_current.w) * t;
+	    add_vertex(out, clipPoint, tcoord_current + (tcoord_next - tcoord_current) * t);
+	}
+    }
+}
+
+/* Corner i of the triangle list is vertex i */
+struct LinearIndices
+{
+    size_t operator[](size_t i) const
+    {
+	return i;
+    }
+};
+
+/* The clipper proper. indices maps every triangle corner to its entry in
+   vertexList, outcodes and tcoordList. Corners shared through the index
+   list are transformed and classified once and only read here. The
+   output is appended to the lists. */
+template<class Indices>
+static void clipTriangleList(
+			     const std::vector<Vector4f>& vertexList,
+			     const std::vector<unsigned short>& outcodes,
+			     const std::vector<Vector4f>& tcoordList,
+			     const Indices& indices,
+			     size_t cornerCount,
+			     std::vector<Vector4f>& outVertexList,
+			     std::vector<Vector4f>& outTCoordList,
+			     const GuardBand& guard)
+{
+    ClipPolygon polygons[2];
+    const Vector4f planes[6] = {
+	Vector4f(-1.0f,  0.0f, 0.0f, guard.scaleX),
+	Vector4f( 1.0f,  0.0f, 0.0f, guard.scaleX),
+	Vector4f( 0.0f,  1.0f, 0.0f, guard.scaleY),
+	Vector4f( 0.0f, -1.0f, 0.0f, guard.scaleY),
+	Vector4f( 0.0f,  0.0f,-1.0f, 1.0f),
+	Vector4f( 0.0f,  0.0f, 1.0f, 1.0f)
+    };
+
+    for(size_t tri=0; tri+2 < cornerCount; tri+=3){
+	size_t corner[3] = { indices[tri], indices[tri+1], indices[tri+2] };
+	unsigned short codeOr = outcodes[corner[0]] | outcodes[corner[1]] | outcodes[corner[2]];
+	int triangleClass = classifyTriangle(outcodes[corner[0]], outcodes[corner[1]], outcodes[corner[2]]);
+	if(triangleClass == TRIANGLE_OUTSIDE){
+	    ++clipRejected;
+	    continue;
+	}
+	/* Culled before clipping, so hidden faces cost no clipping work */
+	if(culled(vertexList[corner[0]], vertexList[corner[1]], vertexList[corner[2]])){
+	    ++trianglesCulled;
+	    continue;
+	}
+	if(triangleClass == TRIANGLE_INSIDE){
+	    ++clipAccepted;
+	    for(int i=0; i<3; ++i){
+		outVertexList.push_back(vertexList[corner[i]]);
+		outTCoordList.push_back(tcoordList[corner[i]]);
+	    }
+	    continue;
+	}
+	++clipClipped;
+
+	ClipPolygon* current = &polygons[0];
+	ClipPolygon* next = &polygons[1];
+	for(int i=0; i<3; ++i){
+	    current->vertex[i] = vertexList[corner[i]];
+	    current->tcoord[i] = tcoordList[corner[i]];
+	}
+	current->count = 3;
+
+	/* Only the planes that some vertex is outside of can cut the triangle */
+	for(int plane=0; plane<6 && current->count >= 3; ++plane){
+	    if(!(codeOr & clipPlaneBits[plane]))
+		continue;
+	    clip_polygon(*current, *next, planes[plane]);
+	    std::swap(current, next);
+	}
+	/* Split the resulting polygon into a fan, like clip_triangle */
+	for(int p=1; p<current->count-1; ++p){
+	    outVertexList.push_back(current->vertex[0]);
+	    outVertexList.push_back(current->vertex[p]);
+	    outVertexList.push_back(current->vertex[p+1]);
+
+	    outTCoordList.push_back(current->tcoord[0]);
+	    outTCoordList.push_back(current->tcoord[p]);
+	    outTCoordList.push_back(current->tcoord[p+1]);
+	}
+    }
+}
+
+void clip_triangles(
+		    const std::vector<Vector4f>& vertexList,
+		    const std::vector<unsigned short>& outcodes,
+		    const std::vector<Vector4f>& tcoordList,
+		    std::vector<Vector4f>& outVertexList,
+		    std::vector<Vector4f>& outTCoordList,
+		    const GuardBand& guard)
+{
+    /* clear() keeps the capacity, so after the first few frames
+       the output lists stop allocating */
+    outVertexList.clear();
+    outTCoordList.clear();
+    clipTriangleList(vertexList, outcodes, tcoordList, LinearIndices(), vertexList.size(),
+		     outVertexList, outTCoordList, guard);
+}
+
+void clip_triangles(
+		    const std::vector<Vector4f>& vertexList,
+		    const std::vector<unsigned short>& outcodes,
+		    const IndexedMesh& mesh,
+		    std::vector<Vector4f>& outVertexList,
+		    std::vector<Vector4f>& outTCoordList,
+		    const GuardBand& guard)
+{
+    outVertexList.clear();
+    outTCoordList.clear();
+    if(mesh.wideIndices())
+	clipTriangleList(vertexList, outcodes, mesh.tcoords, mesh.indices32, mesh.indices32.size(),
+			 outVertexList, outTCoordList, guard);
+    else
+	clipTriangleList(vertexList, outcodes, mesh.tcoords, mesh.indices16, mesh.indices16.size(),
+			 outVertexList, outTCoordList, guard);
+}
+
+void clip_triangles_append(
+			   const std::vector<Vector4f>& vertexList,
+			   const std::vector<unsigned short>& outcodes,
+			   const IndexedMesh& mesh,
+			   unsigned int material,
+			   std::vector<Vector4f>& outVertexList,
+			   std::vector<Vector4f>& outTCoordList,
+			   std::vector<unsigned int>& outMaterials,
+			   const GuardBand& guard)
+{
+    if(mesh.wideIndices())
+	clipTriangleList(vertexList, outcodes, mesh.tcoords, mesh.indices32, mesh.indices32.size(),
+			 outVertexList, outTCoordList, guard);
+    else
+	clipTriangleList(vertexList, outcodes, mesh.tcoords, mesh.indices16, mesh.indices16.size(),
+			 outVertexList, outTCoordList, guard);
+    outMaterials.resize(outVertexList.size() / 3, material);
+}
@@ -12,6 +12,44 @@ Neither the name of the organization nor the names of its contributors may be us
 #ifndef CLIPPLANE_H_GUARD
 #define CLIPPLANE_H_GUARD
 #include <linealg.h>
+#include <vertexstream.h>
+#include <mesh.h>
 void clip_triangle(std::vector<Vector4f>& vertexList, std::vector<Vector4f>& tcoordList, Vector4f plane);
+/* Clips against all six frustum planes in one pass. The output lists are
+   overwritten and can be reused from frame to frame without reallocating.
+   outcodes holds one outcode per vertex (see vertexstream.h), so triangles
+   that are fully inside or fully outside never reach the clipping math.
+   With a guard band, x and y are only clipped at the edge of the band and
+   the outcodes must have been computed with the same guard band */
+void clip_triangles(const std::vector<Vector4f>& vertexList, const std::vector<unsigned short>& outcodes,
+		    const std::vector<Vector4f>& tcoordList,
+		    std::vector<Vector4f>& outVertexList, std::vector<Vector4f>& outTCoordList,
+		    const GuardBand& guard = GuardBand());
+/* Same for an indexed mesh. vertexList and outcodes hold one transformed
+   vertex per mesh vertex, texture coordinates come from the mesh */
+void clip_triangles(const std::vector<Vector4f>& vertexList, const std::vector<unsigned short>& outcodes,
+		    const IndexedMesh& mesh,
+		    std::vector<Vector4f>& outVertexList, std::vector<Vector4f>& outTCoordList,
+		    const GuardBand& guard = GuardBand());
+/* Same for an indexed mesh drawn with one material, but appending to the
+   output lists, so that several draws can go into one batch. outMaterials
+   holds one entry per triangle already in the lists, and gets 'material'
+   once for every triangle that comes out. */
+void clip_triangles_append(const std::vector<Vector4f>& vertexList, const std::vector<unsigned short>& outcodes,
+			   const IndexedMesh& mesh, unsigned int material,
+			   std::vector<Vector4f>& outVertexList, std::vector<Vector4f>& outTCoordList,
+			   std::vector<unsigned int>& outMaterials,
+			   const GuardBand& guard = GuardBand());
+
+enum TriangleClass {TRIANGLE_INSIDE=0, TRIANGLE_OUTSIDE, TRIANGLE_STRADDLING};
+int classifyTriangle(unsigned short outcode1, unsigned short outcode2, unsigned short outcode3);
 int classifyTriangle(const Vector4f& v1, const Vector4f& v2, const Vector4f& v3);
+enum CullMode {CULL_NONE=0, CULL_BACK, CULL_FRONT};
+/* Which faces clip_triangles drops. Front faces are counter-clockwise
+   in normalized device coordinates, which is how meshgen winds them */
+void SetCullMode(CullMode mode);
+/* Number of triangles culled since the last call */
+unsigned int GetCulledTriangles();
+/* How many triangles were accepted, rejected and clipped since the last call */
+void GetClipStats(unsigned int& accepted, unsigned int& rejected, unsigned int& clipped);
 #endif
@@ -3,26 +3,214 @@
 
 Buffer2D<unsigned int> colorbuffer;
 Buffer2D<unsigned short> depthbuffer;
-SDL_Surface* screen;
+std::vector< Buffer2D<unsigned short> > depthPyramid;
+Buffer2D<unsigned char> depthPyramidDirty;
+Buffer2D<unsigned char> tileClears;
+TextureFormat framebufferFormat = TEXTURE_BGRA8_PREMULTIPLIED;
 
-void InitBuffers(unsigned int width, unsigned int height)
+void InitBuffers(unsigned int width, unsigned int height, BufferLayout layout)
 {
-    colorbuffer = Buffer2D<unsigned int>(width, height);
-    depthbuffer = Buffer2D<unsigned short>(width, height);
+    colorbuffer = Buffer2D<unsigned int>(width, height, layout);
+    depthbuffer = Buffer2D<unsigned short>(width, height, layout);
+
+    depthPyramid.clear();
+    unsigned int blockSize = 1 << HIZ_BLOCK_SHIFT;
+    for(int level=0; level<HIZ_LEVELS; ++level){
+	depthPyramid.push_back(Buffer2D<unsigned short>((width + blockSize - 1) / blockSize,
+							(height + blockSize - 1) / blockSize));
+	blockSize *= 2;
+    }
+    depthPyramidDirty = Buffer2D<unsigned char>(depthPyramid[0].w, depthPyramid[0].h);
+
+    unsigned int tileSize = 1 << CLEAR_TILE_SHIFT;
+    tileClears = Buffer2D<unsigned char>((width + tileSize - 1) / tileSize, (height + tileSize - 1) / tileSize);
     return;
 }
 
+/* Bit of 'type' in tileClears */
+static unsigned char clearBit(BufferType type)
+{
+    return 1 << type;
+}
+
+/* The pixel rectangle of tile (tx, ty) */
+static void tileRect(unsigned int tx, unsigned int ty, unsigned int& x0, unsigned int& y0,
+		     unsigned int& x1, unsigned int& y1)
+{
+    x0 = tx << CLEAR_TILE_SHIFT;
+    y0 = ty << CLEAR_TILE_SHIFT;
+    x1 = std::min(x0 + (1 << CLEAR_TILE_SHIFT), depthbuffer.w);
+    y1 = std::min(y0 + (1 << CLEAR_TILE_SHIFT), depthbuffer.h);
+}
+
+/* End of the contiguous run of pixels that starts at x in a row */
+static unsigned int runEnd(unsigned int x, unsigned int x1, unsigned int shift)
+{
+    return shift ? std::min(x1, (x | ((1u << shift) - 1)) + 1) : x1;
+}
+
+/* Fills pixels x0..x1-1 of rows y0..y1-1 */
+template<typename T>
+static void fillPixels(T* data, unsigned int pitch, unsigned int shift,
+		       unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1, T value)
+{
+    for(unsigned int y=y0; y<y1; ++y){
+	for(unsigned int x=x0; x<x1; ){
+	    unsigned int end = runEnd(x, x1, shift);
+	    T* run = data + PixelIndex(x, y, pitch, shift);
+	    std::fill(run, run + (end - x), value);
+	    x = end;
+	}
+    }
+}
+
+static void clearTile(unsigned int tx, unsigned int ty, unsigned char bits,
+		      unsigned int* pixels, unsigned int pitch)
+{
+    unsigned int x0, y0, x1, y1;
+    tileRect(tx, ty, x0, y0, x1, y1);
+    if(bits & clearBit(COLOR_BUFFER))
+	fillPixels(pixels, pitch, depthbuffer.shift, x0, y0, x1, y1, 0u);
+    if(bits & clearBit(DEPTH_BUFFER))
+	fillPixels(&depthbuffer.data[0], depthbuffer.pitch, depthbuffer.shift, x0, y0, x1, y1, (unsigned short)65535);
+}
+
+/* The depth pyramid is cleared right away. It is 1/64th of the depth
+   buffer, and hierarchical Z reads it before any tile is drawn into. */
 void ClearBuffer(BufferType type)
 {
-    switch(type)
-    {
-    case COLOR_BUFFER:
-	std::fill(colorbuffer.data.begin(), colorbuffer.data.end(), 0);
-	break;
-    case DEPTH_BUFFER:
-	std::fill(depthbuffer.data.begin(), depthbuffer.data.end(), 65535);
-	break;
+    for(size_t i=0; i<tileClears.data.size(); ++i)
+	tileClears.data[i] |= clearBit(type);
+    if(type == DEPTH_BUFFER){
+	for(size_t i=0; i<depthPyramid.size(); ++i)
+	    std::fill(depthPyramid[i].data.begin(), depthPyramid[i].data.end(), 65535);
+	std::fill(depthPyramidDirty.data.begin(), depthPyramidDirty.data.end(), 0);
     }
     return;
 }
 
+void ResolveTileClears(int x0, int y0, int x1, int y1, unsigned int* pixels, unsigned int pitch)
+{
+    for(int ty = y0 >> CLEAR_TILE_SHIFT; ty <= (y1 >> CLEAR_TILE_SHIFT); ++ty){
+	for(int tx = x0 >> CLEAR_TILE_SHIFT; tx <= (x1 >> CLEAR_TILE_SHIFT); ++tx){
+	    unsigned char& bits = tileClears.row(ty)[tx];
+	    if(bits){
+		clearTile(tx, ty, bits, pixels, pitch);
+		bits = 0;
+	    }
+	}
+    }
+}
+
+void ResolveClear(BufferType type, unsigned int* pixels, unsigned int pitch)
+{
+    if(!pixels)
+	pixels = colorbuffer.data.empty() ? NULL : &colorbuffer.data[0];
+    if(!pitch)
+	pitch = colorbuffer.pitch;
+    for(unsigned int ty=0; ty<tileClears.h; ++ty){
+	for(unsigned int tx=0; tx<tileClears.w; ++tx){
+	    unsigned char& bits = tileClears.row(ty)[tx];
+	    if(bits & clearBit(type)){
+		clearTile(tx, ty, clearBit(type), pixels, pitch);
+		bits &= ~clearBit(type);
+	    }
+	}
+    }
+}
+
+void ResolveColorBuffer(unsigned int* pixels, unsigned int pitch, TextureFormat format)
+{
+    for(unsigned int ty=0; ty<tileClears.h; ++ty){
+	for(unsigned int tx=0; tx<tileClears.w; ++tx){
+	    unsigned int x0, y0, x1, y1;
+	    tileRect(tx, ty, x0, y0, x1, y1);
+	    if(tileClears.row(ty)[tx] & clearBit(COLOR_BUFFER)){
+		fillPixels(pixels, pitch, 0, x0, y0, x1, y1, 0u);
+		continue;
+	    }
+	    for(unsigned int y=y0; y<y1; ++y){
+		for(unsigned int x=x0; x<x1; ){
+		    unsigned int end = runEnd(x, x1, colorbuffer.shift);
+		    ConvertTexels(pixels + y*pitch + x, &colorbuffer.data[colorbuffer.index(x, y)],
+				  end - x, framebufferFormat, format);
+		    x = end;
+		}
+	    }
+	}
+    }
+}
+
+/* Recomputes the dirty 8x8 blocks under the rectangle, then the cells
+   above them. Parents may also cover blocks outside the rectangle that
+   are still dirty, but those hold stale, larger values, so the parents
+   stay conservative. */
+void RefreshDepthPyramid(int x0, int y0, int x1, int y1)
+{
+    bool changed = false;
+    int bx0 = x0 >> HIZ_BLOCK_SHIFT, bx1 = x1 >> HIZ_BLOCK_SHIFT;
+    int by0 = y0 >> HIZ_BLOCK_SHIFT, by1 = y1 >> HIZ_BLOCK_SHIFT;
+    Buffer2D<unsigned short>& base = depthPyramid[0];
+
+    for(int by=by0; by<=by1; ++by){
+	for(int bx=bx0; bx<=bx1; ++bx){
+	    unsigned char& dirty = depthPyramidDirty.row(by)[bx];
+	    if(!dirty)
+		continue;
+	    dirty = 0;
+	    changed = true;
+
+	    int px0 = bx << HIZ_BLOCK_SHIFT;
+	    int py0 = by << HIZ_BLOCK_SHIFT;
+	    int px1 = std::min<int>(px0 + (1 << HIZ_BLOCK_SHIFT), depthbuffer.w);
+	    int py1 = std::min<int>(py0 + (1 << HIZ_BLOCK_SHIFT), depthbuffer.h);
+	    unsigned short mx = 0;
+	    /* A block row is contiguous in every layout, since the tiled
+	       layouts use blocks of at least 8x8 */
+	    for(int y=py0; y<py1; ++y){
+		const unsigned short* row = &depthbuffer.data[depthbuffer.index(px0, y)];
+		for(int x=0; x<px1-px0; ++x)
+		    mx = std::max(mx, row[x]);
+	    }
+	    base.row(by)[bx] = mx;
+	}
+    }
+    if(!changed)
+	return;
+
+    for(int level=1; level<HIZ_LEVELS; ++level){
+	const Buffer2D<unsigned short>& child = depthPyramid[level - 1];
+	Buffer2D<unsigned short>& parent = depthPyramid[level];
+	bx0 >>= 1; bx1 >>= 1;
+	by0 >>= 1; by1 >>= 1;
+	for(int by=by0; by<=by1; ++by){
+	    for(int bx=bx0; bx<=bx1; ++bx){
+		unsigned short mx = 0;
+		for(int cy=by*2; cy<std::min(by*2 + 2, (int)child.h); ++cy)
+		    for(int cx=bx*2; cx<std::min(bx*2 + 2, (int)child.w); ++cx)
+			mx = std::max(mx, child.row(cy)[cx]);
+		parent.row(by)[bx] = mx;
+	    }
+	}
+    }
+}
+
+/* Picks the finest level where the rectangle spans at most 2x2 cells,
+   so the lookup is a handful of reads for any triangle up to tile size. */
+unsigned short DepthPyramidMax(int x0, int y0, int x1, int y1)
+{
+    int level = 0;
+    int shift = HIZ_BLOCK_SHIFT;
+    while(level < HIZ_LEVELS - 1 &&
+	  (((x1 >> shift) - (x0 >> shift)) > 1 || ((y1 >> shift) - (y0 >> shift)) > 1)){
+	++level;
+	++shift;
+    }
+
+    const Buffer2D<unsigned short>& cells = depthPyramid[level];
+    unsigned short mx = 0;
+    for(int by = y0 >> shift; by <= (y1 >> shift); ++by)
+	for(int bx = x0 >> shift; bx <= (x1 >> shift); ++bx)
+	    mx = std::max(mx, cells.row(by)[bx]);
+    return mx;
+}
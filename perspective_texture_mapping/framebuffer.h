@@ -11,24 +11,77 @@ Neither the name of the organization nor the names of its contributors may be us
 
 #ifndef FRAMEBUFFER_H_GUARD
 #define FRAMEBUFFER_H_GUARD
-#include <SDL/SDL.h>
 #include <vector>
+#include <algorithm>
+#include "texture.h"
+#include "bufferalloc.h"
 
+/* Order of the pixels in a Buffer2D. The tiled layouts store square
+   blocks of pixels one after another, each block row by row, so a block
+   is a few cache lines and the 64x64 tile a thread draws into is a few
+   pages. The value is log2 of the block side. */
+enum BufferLayout
+{
+    BUFFER_LINEAR=0,  /* Row by row */
+    BUFFER_TILED8=3,  /* 8x8 blocks */
+    BUFFER_TILED16=4  /* 16x16 blocks */
+};
+
+/* Offset of pixel (x, y) in a buffer with the layout 'shift', where
+   'pitch' is the elements from one row to the next, or from one row of
+   blocks to the next in the tiled layouts. */
+inline size_t PixelIndex(unsigned int x, unsigned int y, unsigned int pitch, unsigned int shift)
+{
+    unsigned int mask = (1u << shift) - 1;
+    return (size_t)(y >> shift)*pitch + ((y & mask) << shift) + ((x >> shift) << (2*shift)) + (x & mask);
+}
+
+/* PixelIndex(x, y) - PixelIndex(0, y), for loops along a row. The runs
+   of x in one block are contiguous. */
+template<bool Tiled> inline unsigned int PixelColumn(unsigned int x, unsigned int shift)
+{
+    return Tiled ? ((x >> shift) << (2*shift)) + (x & ((1u << shift) - 1)) : x;
+}
+
+/* In the linear layout rows start 'pitch' elements apart, which is
+   BufferPitch(width) unless given. The data starts on a cache line, so
+   with the default pitch every row does. In the tiled layouts the blocks
+   do, and the edge blocks are padded out. */
 template<typename T> struct Buffer2D
 {
-    Buffer2D(unsigned int width, unsigned int height) : w(width), h(height), data(width*height){}
-    Buffer2D() : w(0), h(0), data(){}
+    Buffer2D(unsigned int width, unsigned int height) :
+        w(width), h(height), pitch(BufferPitch(width, sizeof(T))), shift(0), data((size_t)pitch*height){}
+    Buffer2D(unsigned int width, unsigned int height, unsigned int rowPitch) :
+        w(width), h(height), pitch(std::max(rowPitch, width)), shift(0), data((size_t)pitch*height){}
+    Buffer2D(unsigned int width, unsigned int height, BufferLayout layout) :
+        w(width), h(height), shift(layout)
+    {
+        if(layout == BUFFER_LINEAR){
+            pitch = BufferPitch(width, sizeof(T));
+            data.resize((size_t)pitch*height);
+            return;
+        }
+        unsigned int side = 1u << shift;
+        pitch = ((width + side - 1) >> shift) << (2*shift);
+        data.resize((size_t)pitch*((height + side - 1) >> shift));
+    }
+    Buffer2D() : w(0), h(0), pitch(0), shift(0), data(){}
     T& operator[](size_t index){ return data[index]; }
     const T& operator[](size_t index) const { return data[index]; }
+    size_t index(unsigned int x, unsigned int y) const { return PixelIndex(x, y, pitch, shift); }
+    /* Only for the linear layout */
+    T* row(unsigned int y){ return &data[(size_t)y*pitch]; }
+    const T* row(unsigned int y) const { return &data[(size_t)y*pitch]; }
 
     unsigned int w;
     unsigned int h;
-    std::vector<T> data;
+    unsigned int pitch;
+    unsigned int shift;  /* BufferLayout */
+    std::vector< T, BufferAllocator<T> > data;
 };
 
 extern Buffer2D<unsigned int> colorbuffer;
 extern Buffer2D<unsigned short> depthbuffer;
-extern SDL_Surface* screen;
 
 enum BufferType
 {
@@ -36,6 +89,75 @@ enum BufferType
     DEPTH_BUFFER
 };
 
-void InitBuffers(unsigned int width, unsigned int height);
+/* Format of the pixels on the display and in colorbuffer,
+   TEXTURE_BGRA8_PREMULTIPLIED unless set to the byte order of the
+   display. Textures loaded in this format are written to the buffers as
+   they are. */
+extern TextureFormat framebufferFormat;
+
+/* colorbuffer and depthbuffer get 'layout'. The rasterizer draws into
+   color buffers with the layout of depthbuffer, so with a tiled layout
+   it draws into colorbuffer, and ResolveColorBuffer copies that out. */
+void InitBuffers(unsigned int width, unsigned int height, BufferLayout layout = BUFFER_LINEAR);
+/* Copies colorbuffer into a linear buffer of 32-bit pixels with rows
+   'pitch' pixels apart, such as the screen surface, converting it to
+   'format' on the way. Blocks still pending a color clear are written
+   as 0 without reading colorbuffer. */
+void ResolveColorBuffer(unsigned int* pixels, unsigned int pitch, TextureFormat format);
+
+/* Clears are lazy. ClearBuffer only marks every 64x64 tile as pending,
+   and a tile gets its clear value written when the rasterizer first
+   draws into it. Color is cleared to 0 and depth to 65535. Color clears
+   apply to the buffer the rasterizer draws into, which is colorbuffer or
+   the screen surface, so they take its pointer and pitch. */
+#define CLEAR_TILE_SHIFT 6
+
+extern Buffer2D<unsigned char> tileClears;
+
 void ClearBuffer(BufferType type);
+/* Writes the clears still pending in the tiles under the inclusive pixel
+   rectangle */
+void ResolveTileClears(int x0, int y0, int x1, int y1, unsigned int* pixels, unsigned int pitch);
+/* Writes the clears of 'type' that are still pending anywhere. Call it
+   on the color buffer before it is shown, the tiles nothing was drawn
+   into get their clear value there. Without pixels, colorbuffer does,
+   and a pitch of 0 is the pitch of colorbuffer. ResolveColorBuffer does
+   this itself. */
+void ResolveClear(BufferType type, unsigned int* pixels = NULL, unsigned int pitch = 0);
+
+/* Hierarchical Z. A max-depth pyramid kept next to depthbuffer.
+   Level 0 holds the largest depth of each 8x8 pixel block, every level
+   above halves the resolution, up to 64x64 pixel cells. That is the tile
+   size of the threaded rasterizer, so a tile owns all the cells it
+   touches. The values are conservative: a cell may be larger than the
+   real max of its pixels, but never smaller. Writers mark blocks dirty,
+   and RefreshDepthPyramid brings the dirty blocks in a rectangle up to
+   date. */
+#define HIZ_BLOCK_SHIFT 3
+#define HIZ_LEVELS 4
+
+extern std::vector< Buffer2D<unsigned short> > depthPyramid;
+extern Buffer2D<unsigned char> depthPyramidDirty;
+
+/* Pixels x0..x1 of row y had their depth written */
+inline void MarkDepthDirty(int y, int x0, int x1)
+{
+    unsigned char* dirty = depthPyramidDirty.row(y >> HIZ_BLOCK_SHIFT);
+    for(int bx = x0 >> HIZ_BLOCK_SHIFT; bx <= (x1 >> HIZ_BLOCK_SHIFT); ++bx)
+	dirty[bx] = 1;
+}
+
+/* Upper bound of the depth in pixels x0..x1 of row y, from level 0 */
+inline unsigned short DepthPyramidSpanMax(int y, int x0, int x1)
+{
+    const unsigned short* cells = depthPyramid[0].row(y >> HIZ_BLOCK_SHIFT);
+    unsigned short mx = 0;
+    for(int bx = x0 >> HIZ_BLOCK_SHIFT; bx <= (x1 >> HIZ_BLOCK_SHIFT); ++bx)
+	mx = std::max(mx, cells[bx]);
+    return mx;
+}
+
+/* Both take an inclusive pixel rectangle */
+void RefreshDepthPyramid(int x0, int y0, int x1, int y1);
+unsigned short DepthPyramidMax(int x0, int y0, int x1, int y1);
 #endif
@@ -0,0 +1,502 @@
+#include <vector>
+#include <algorithm>
+#include <linealg.h>
+#include "rastersetup.h"
+#include "framebuffer.h"
+#include "texture.h"
+#include "myassert.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Half-space rasterizer.
+
+   Coverage is decided by three edge functions evaluated on 4x2 pixel
+   blocks. Vertices come in as Q15.16 and are snapped to Q27.4 before the
+   edge setup, so the per-pixel edge steps fit in 32 bits even for
+   triangles spanning thousands of pixels. Sample points are at the
+   integer pixel coordinates with a top-left fill rule, the same
+   convention as the scanline engine, so both cover the same pixels up to
+   the subpixel snapping.
+
+   Depth, 1/w, s/w and t/w are evaluated from plane equations. Depth is
+   clamped to the vertex range, truncated to 16 bits and tested with '<'
+   like in drawScanLine. */
+
+/* A block row is 4 contiguous pixels in every framebuffer layout, the
+   tiled ones store at least 8x8 pixels together */
+#define BLOCK_W 4
+#define BLOCK_H 2
+#define SUBPIXEL_BITS 4
+
+/* Edge function E(px, py) = stepX*px + stepY*py + c for whole pixels.
+   The top-left bias is folded into c, so a pixel is inside when E >= 0. */
+struct EdgeFunction
+{
+  long long stepX, stepY;
+  long long c;
+};
+
+/* a(px, py) = a0 + dx*px + dy*py, relative to the block origin */
+struct Plane
+{
+  float a0, dx, dy;
+};
+
+static void setupEdge(EdgeFunction& edge, long long xa, long long ya, long long xb, long long yb)
+{
+  long long A = ya - yb;
+  long long B = xb - xa;
+  bool topLeft = (A > 0) || (A == 0 && B > 0);
+
+  edge.stepX = A << SUBPIXEL_BITS;
+  edge.stepY = B << SUBPIXEL_BITS;
+  edge.c = -A*xa - B*ya - (topLeft ? 0 : 1);
+}
+
+static void setupPlane(Plane& plane,
+		       float x0, float y0, float a0,
+		       float x1, float y1, float a1,
+		       float x2, float y2, float a2)
+{
+  float det = (x1 - x0)*(y2 - y0) - (x2 - x0)*(y1 - y0);
+  float detInv = 1.0f / det;
+  plane.dx = ((a1 - a0)*(y2 - y0) - (a2 - a0)*(y1 - y0)) * detInv;
+  plane.dy = ((a2 - a0)*(x1 - x0) - (a1 - a0)*(x2 - x0)) * detInv;
+  plane.a0 = a0 - plane.dx*x0 - plane.dy*y0;
+}
+
+inline float evalPlane(const Plane& plane, int px, int py)
+{
+  return plane.a0 + (plane.dx*(float)px + plane.dy*(float)py);
+}
+
+inline long long evalEdge(const EdgeFunction& edge, int px, int py)
+{
+  return edge.stepX*px + edge.stepY*py + edge.c;
+}
+
+/* Clamped so that corner + lane offsets can't overflow 32 bits. Lane
+   offsets are far below the clamp, so the sign of every lane survives. */
+inline int clampEdge(long long e)
+{
+  const long long limit = 1LL << 29;
+  return (int)std::min(std::max(e, -limit), limit);
+}
+
+/* Rounds towards negative infinity, d > 0 */
+inline long long floorDiv(long long n, long long d)
+{
+  return n >= 0 ? n / d : -((-n + d - 1) / d);
+}
+
+struct BlockSetup
+{
+  EdgeFunction edges[3];
+  Plane z, w, s, t;
+  float zMin, zMax;
+  const Texture* texture;
+  const TexelAddress* levels;
+  std::atomic<unsigned int>* mipFeedback;
+  const TexelAddress* address;
+  float texMaxS, texMaxT;
+  unsigned int level; /* Mip level the texture fields point at */
+#if !defined(__AVX2__) && defined(__SSE2__)
+  __m128i edgeLanes[3]; /* E offsets of the four pixels in a row */
+#endif
+};
+
+/* Points the texture fields at a mip level */
+static void bindLevel(BlockSetup& bs, unsigned int level)
+{
+  bs.address = &bs.levels[level];
+  bs.texMaxS = (float)bs.address->maxS;
+  bs.texMaxT = (float)bs.address->maxT;
+  bs.level = level;
+}
+
+/* Mip level for a block, picked at its center */
+static void selectBlockLevel(BlockSetup& bs, int bx, int by)
+{
+  float cx = bx + (BLOCK_W - 1) * 0.5f;
+  float cy = by + (BLOCK_H - 1) * 0.5f;
+  unsigned int level = SelectMipLevel(bs.texture, *bs.mipFeedback,
+				      bs.w.a0 + bs.w.dx*cx + bs.w.dy*cy,
+				      bs.s.a0 + bs.s.dx*cx + bs.s.dy*cy,
+				      bs.t.a0 + bs.t.dx*cx + bs.t.dy*cy,
+				      bs.w.dx, bs.w.dy, bs.s.dx, bs.s.dy, bs.t.dx, bs.t.dy);
+  if(level != bs.level)
+    bindLevel(bs, level);
+}
+
+/* Reference per-pixel path. Used where a block crosses the clip
+   rectangle, and for the whole triangle when no SIMD is available. */
+static void shadeBlockScalar(const BlockSetup& bs, unsigned int* buffer, unsigned int pitch,
+			     const ClipRect& clip, int bx, int by)
+{
+  for(int j=0; j<BLOCK_H; ++j){
+    int py = by + j;
+    if(py < clip.y0 || py > clip.y1)
+      continue;
+    for(int i=0; i<BLOCK_W; ++i){
+      int px = bx + i;
+      if(px < clip.x0 || px > clip.x1)
+	continue;
+      if(evalEdge(bs.edges[0], px, py) < 0 ||
+	 evalEdge(bs.edges[1], px, py) < 0 ||
+	 evalEdge(bs.edges[2], px, py) < 0)
+	continue;
+      unsigned short& depth = depthbuffer[depthbuffer.index(px, py)];
+      unsigned int z = (unsigned int)std::min(std::max(evalPlane(bs.z, px, py), bs.zMin), bs.zMax);
+      if(z >= depth)
+	continue;
+      float wInv = 1.0f / evalPlane(bs.w, px, py);
+      float s = std::min(std::max(evalPlane(bs.s, px, py) * wInv * bs.texMaxS, 0.0f), bs.texMaxS);
+      float t = std::min(std::max(evalPlane(bs.t, px, py) * wInv * bs.texMaxT, 0.0f), bs.texMaxT);
+      depth = z;
+      if(bilinearFiltering)
+	buffer[PixelIndex(px, py, pitch, depthbuffer.shift)] = bs.address->bilinear((int)(s * 65536.0f), (int)(t * 65536.0f));
+      else
+	buffer[PixelIndex(px, py, pitch, depthbuffer.shift)] = bs.address->fetch((int)s, (int)t);
+      if(hierarchicalZ)
+	MarkDepthDirty(py, px, px);
+    }
+  }
+}
+
+#if defined(__AVX2__)
+
+/* TexelAddress::index for all lanes. The coordinates must already be
+   clamped, and a shift of 0 turns the tile terms into the linear ones. */
+static inline __m256i texelIndex(const TexelAddress& a, __m256i si, __m256i ti)
+{
+  int shift = a.tiled ? TEXTURE_TILE_SHIFT : 0;
+  __m128i tileShift = _mm_cvtsi32_si128(shift);
+  __m128i tileShift2 = _mm_cvtsi32_si128(2*shift);
+  __m256i tileMask = _mm256_set1_epi32((1 << shift) - 1);
+  __m256i row = a.pow2 ?
+    _mm256_sll_epi32(_mm256_srl_epi32(ti, tileShift), _mm_cvtsi32_si128(a.pitchShift)) :
+    _mm256_mullo_epi32(_mm256_srl_epi32(ti, tileShift), _mm256_set1_epi32(a.pitch));
+  return _mm256_add_epi32(_mm256_add_epi32(row, _mm256_sll_epi32(_mm256_srl_epi32(si, tileShift), tileShift2)),
+			  _mm256_add_epi32(_mm256_sll_epi32(_mm256_and_si256(ti, tileMask), tileShift),
+					   _mm256_and_si256(si, tileMask)));
+}
+
+/* All 8 pixels of a block in one register. Lanes 0-3 are the top row,
+   lanes 4-7 the bottom row. */
+static void shadeBlock(const BlockSetup& bs, unsigned int* buffer, unsigned int pitch,
+		       int bx, int by, const int* corner)
+{
+  const __m256i laneX = _mm256_setr_epi32(0, 1, 2, 3, 0, 1, 2, 3);
+  const __m256i laneY = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+  const __m256 laneXf = _mm256_cvtepi32_ps(laneX);
+  const __m256 laneYf = _mm256_cvtepi32_ps(laneY);
+
+  __m256i mask = _mm256_set1_epi32(-1);
+  for(int e=0; e<3; ++e){
+    __m256i value = _mm256_add_epi32(_mm256_set1_epi32(corner[e]),
+		    _mm256_add_epi32(_mm256_mullo_epi32(laneX, _mm256_set1_epi32((int)bs.edges[e].stepX)),
+				     _mm256_mullo_epi32(laneY, _mm256_set1_epi32((int)bs.edges[e].stepY))));
+    mask = _mm256_andnot_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), value), mask);
+  }
+  if(_mm256_testz_si256(mask, mask))
+    return;
+
+  size_t index0 = PixelIndex(bx, by, pitch, depthbuffer.shift);
+  size_t index1 = PixelIndex(bx, by + 1, pitch, depthbuffer.shift);
+  unsigned short* zrow0 = &depthbuffer[depthbuffer.index(bx, by)];
+  unsigned short* zrow1 = &depthbuffer[depthbuffer.index(bx, by + 1)];
+
+  __m256 fx = _mm256_add_ps(_mm256_set1_ps((float)bx), laneXf);
+  __m256 fy = _mm256_add_ps(_mm256_set1_ps((float)by), laneYf);
+#define PLANE(p) _mm256_add_ps(_mm256_set1_ps(p.a0), \
+		 _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(p.dx), fx), _mm256_mul_ps(_mm256_set1_ps(p.dy), fy)))
+
+  __m256i z = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(PLANE(bs.z), _mm256_set1_ps(bs.zMin)),
+						_mm256_set1_ps(bs.zMax)));
+  __m256i zOld = _mm256_cvtepu16_epi32(_mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)zrow0),
+							  _mm_loadl_epi64((const __m128i*)zrow1)));
+  mask = _mm256_and_si256(mask, _mm256_cmpgt_epi32(zOld, z));
+  if(_mm256_testz_si256(mask, mask))
+    return;
+
+  __m256 wInv = _mm256_div_ps(_mm256_set1_ps(1.0f), PLANE(bs.w));
+  __m256 s = _mm256_mul_ps(_mm256_mul_ps(PLANE(bs.s), wInv), _mm256_set1_ps(bs.texMaxS));
+  __m256 t = _mm256_mul_ps(_mm256_mul_ps(PLANE(bs.t), wInv), _mm256_set1_ps(bs.texMaxT));
+#undef PLANE
+  s = _mm256_min_ps(_mm256_max_ps(s, _mm256_setzero_ps()), _mm256_set1_ps(bs.texMaxS));
+  t = _mm256_min_ps(_mm256_max_ps(t, _mm256_setzero_ps()), _mm256_set1_ps(bs.texMaxT));
+  const TexelAddress& a = *bs.address;
+  const int* texels = (const int*)a.texels;
+  __m256i texel;
+  if(a.layout == TEXTURE_BC1){
+    /* Blocks go through the decode cache, one covered lane at a time */
+    alignas(32) int si[8], ti[8];
+    alignas(32) unsigned int lanes[8] = { 0 };
+    int covered = _mm256_movemask_ps(_mm256_castsi256_ps(mask));
+    if(bilinearFiltering){
+      const __m256 q16 = _mm256_set1_ps(65536.0f);
+      _mm256_store_si256((__m256i*)si, _mm256_cvttps_epi32(_mm256_mul_ps(s, q16)));
+      _mm256_store_si256((__m256i*)ti, _mm256_cvttps_epi32(_mm256_mul_ps(t, q16)));
+    } else {
+      _mm256_store_si256((__m256i*)si, _mm256_cvttps_epi32(s));
+      _mm256_store_si256((__m256i*)ti, _mm256_cvttps_epi32(t));
+    }
+    for(int i=0; i<8; ++i)
+      if(covered & (1 << i))
+	lanes[i] = bilinearFiltering ? a.bilinear(si[i], ti[i]) : a.fetch(si[i], ti[i]);
+    texel = _mm256_load_si256((const __m256i*)lanes);
+  } else if(bilinearFiltering){
+    /* Same as TexelAddress::bilinear. s and t are clamped, so only the
+       far neighbours need clamping. */
+    const __m256 q16 = _mm256_set1_ps(65536.0f);
+    const __m256i fraction = _mm256_set1_epi32(255);
+    __m256i sq = _mm256_cvttps_epi32(_mm256_mul_ps(s, q16));
+    __m256i tq = _mm256_cvttps_epi32(_mm256_mul_ps(t, q16));
+    __m256i s0 = _mm256_srai_epi32(sq, 16);
+    __m256i t0 = _mm256_srai_epi32(tq, 16);
+    __m256i s1 = _mm256_min_epi32(_mm256_add_epi32(s0, _mm256_set1_epi32(1)), _mm256_set1_epi32(a.maxS));
+    __m256i t1 = _mm256_min_epi32(_mm256_add_epi32(t0, _mm256_set1_epi32(1)), _mm256_set1_epi32(a.maxT));
+    const __m256i zero = _mm256_setzero_si256();
+    texel = BilinearBlend8(_mm256_mask_i32gather_epi32(zero, texels, texelIndex(a, s0, t0), mask, 4),
+			   _mm256_mask_i32gather_epi32(zero, texels, texelIndex(a, s1, t0), mask, 4),
+			   _mm256_mask_i32gather_epi32(zero, texels, texelIndex(a, s0, t1), mask, 4),
+			   _mm256_mask_i32gather_epi32(zero, texels, texelIndex(a, s1, t1), mask, 4),
+			   _mm256_and_si256(_mm256_srli_epi32(sq, 8), fraction),
+			   _mm256_and_si256(_mm256_srli_epi32(tq, 8), fraction));
+  } else {
+    __m256i texIndex = texelIndex(a, _mm256_cvttps_epi32(s), _mm256_cvttps_epi32(t));
+    texel = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), texels, texIndex, mask, 4);
+  }
+
+  /* Masked read-modify-write of both rows */
+  __m256i colorOld = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)&buffer[index0])),
+					     _mm_loadu_si128((const __m128i*)&buffer[index1]), 1);
+  __m256i color = _mm256_blendv_epi8(colorOld, texel, mask);
+  _mm_storeu_si128((__m128i*)&buffer[index0], _mm256_castsi256_si128(color));
+  _mm_storeu_si128((__m128i*)&buffer[index1], _mm256_extracti128_si256(color, 1));
+
+  __m256i zNew = _mm256_blendv_epi8(zOld, z, mask);
+  __m128i zPacked = _mm_packus_epi32(_mm256_castsi256_si128(zNew), _mm256_extracti128_si256(zNew, 1));
+  _mm_storel_epi64((__m128i*)zrow0, zPacked);
+  _mm_storel_epi64((__m128i*)zrow1, _mm_unpackhi_epi64(zPacked, zPacked));
+  if(hierarchicalZ){
+    MarkDepthDirty(by, bx, bx + BLOCK_W - 1);
+    MarkDepthDirty(by + 1, bx, bx + BLOCK_W - 1);
+  }
+}
+
+#elif defined(__SSE2__)
+
+/* SSE2 has no 32-bit multiply, blend or gather, so one row of four
+   pixels is handled at a time and the texel fetch is done per lane. */
+static inline __m128i select128(__m128i mask, __m128i a, __m128i b)
+{
+  return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static void shadeBlock(const BlockSetup& bs, unsigned int* buffer, unsigned int pitch,
+		       int bx, int by, const int* corner)
+{
+  const __m128 laneXf = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+  const __m128i bias16 = _mm_set1_epi32(0x8000);
+
+  for(int j=0; j<BLOCK_H; ++j){
+    __m128i mask = _mm_set1_epi32(-1);
+    for(int e=0; e<3; ++e){
+      __m128i value = _mm_add_epi32(_mm_set1_epi32(corner[e] + j*(int)bs.edges[e].stepY), bs.edgeLanes[e]);
+      mask = _mm_andnot_si128(_mm_cmplt_epi32(value, _mm_setzero_si128()), mask);
+    }
+    if(!_mm_movemask_epi8(mask))
+      continue;
+
+    size_t index = PixelIndex(bx, by + j, pitch, depthbuffer.shift);
+    unsigned short* zrow = &depthbuffer[depthbuffer.index(bx, by + j)];
+    __m128 fx = _mm_add_ps(_mm_set1_ps((float)bx), laneXf);
+    __m128 fy = _mm_set1_ps((float)(by + j));
+#define PLANE(p) _mm_add_ps(_mm_set1_ps(p.a0), \
+		 _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.dx), fx), _mm_mul_ps(_mm_set1_ps(p.dy), fy)))
+
+    __m128i z = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(PLANE(bs.z), _mm_set1_ps(bs.zMin)),
+					    _mm_set1_ps(bs.zMax)));
+    __m128i zOld = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)zrow), _mm_setzero_si128());
+    mask = _mm_and_si128(mask, _mm_cmplt_epi32(z, zOld));
+    if(!_mm_movemask_epi8(mask))
+      continue;
+
+    __m128 wInv = _mm_div_ps(_mm_set1_ps(1.0f), PLANE(bs.w));
+    __m128 s = _mm_mul_ps(_mm_mul_ps(PLANE(bs.s), wInv), _mm_set1_ps(bs.texMaxS));
+    __m128 t = _mm_mul_ps(_mm_mul_ps(PLANE(bs.t), wInv), _mm_set1_ps(bs.texMaxT));
+#undef PLANE
+    s = _mm_min_ps(_mm_max_ps(s, _mm_setzero_ps()), _mm_set1_ps(bs.texMaxS));
+    t = _mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), _mm_set1_ps(bs.texMaxT));
+    int si[4], ti[4];
+    const TexelAddress& a = *bs.address;
+    __m128i texel;
+    if(bilinearFiltering){
+      /* Per lane fetch of the 2x2 footprints, blended all at once */
+      const __m128 q16 = _mm_set1_ps(65536.0f);
+      const __m128i fraction = _mm_set1_epi32(255);
+      __m128i sq = _mm_cvttps_epi32(_mm_mul_ps(s, q16));
+      __m128i tq = _mm_cvttps_epi32(_mm_mul_ps(t, q16));
+      unsigned int footprint[4][4];
+      _mm_storeu_si128((__m128i*)si, _mm_srai_epi32(sq, 16));
+      _mm_storeu_si128((__m128i*)ti, _mm_srai_epi32(tq, 16));
+      for(int i=0; i<4; ++i){
+	footprint[0][i] = a.fetch(si[i], ti[i]);
+	footprint[1][i] = a.fetch(si[i] + 1, ti[i]);
+	footprint[2][i] = a.fetch(si[i], ti[i] + 1);
+	footprint[3][i] = a.fetch(si[i] + 1, ti[i] + 1);
+      }
+      texel = BilinearBlend4(_mm_loadu_si128((const __m128i*)footprint[0]),
+			     _mm_loadu_si128((const __m128i*)footprint[1]),
+			     _mm_loadu_si128((const __m128i*)footprint[2]),
+			     _mm_loadu_si128((const __m128i*)footprint[3]),
+			     _mm_and_si128(_mm_srli_epi32(sq, 8), fraction),
+			     _mm_and_si128(_mm_srli_epi32(tq, 8), fraction));
+    } else {
+      _mm_storeu_si128((__m128i*)si, _mm_cvttps_epi32(s));
+      _mm_storeu_si128((__m128i*)ti, _mm_cvttps_epi32(t));
+      texel = _mm_setr_epi32(a.fetch(si[0], ti[0]), a.fetch(si[1], ti[1]),
+			     a.fetch(si[2], ti[2]), a.fetch(si[3], ti[3]));
+    }
+
+    __m128i colorOld = _mm_loadu_si128((const __m128i*)&buffer[index]);
+    _mm_storeu_si128((__m128i*)&buffer[index], select128(mask, texel, colorOld));
+
+    /* Signed saturating pack, so shift the unsigned depths into range and back */
+    __m128i zNew = _mm_sub_epi32(select128(mask, z, zOld), bias16);
+    __m128i zPacked = _mm_xor_si128(_mm_packs_epi32(zNew, zNew), _mm_set1_epi16((short)0x8000));
+    _mm_storel_epi64((__m128i*)zrow, zPacked);
+    if(hierarchicalZ)
+      MarkDepthDirty(by + j, bx, bx + BLOCK_W - 1);
+  }
+}
+
+#endif
+
+void RasterizeTriangleHalfSpace(const TriangleSetup& setup,
+				unsigned int* buffer,
+				unsigned int pitch,
+				const ClipRect& clip)
+{
+  const int shift = 16 - SUBPIXEL_BITS;
+  Vector4i v[3] = { setup.v1fp, setup.v2fp, setup.v3fp };
+  Vector4i tc[3] = { setup.tc1fp, setup.tc2fp, setup.tc3fp };
+  long long x[3], y[3];
+
+  for(int i=0; i<3; ++i){
+    x[i] = v[i].x >> shift;
+    y[i] = v[i].y >> shift;
+  }
+
+  /* Make the winding consistent so the inside is E >= 0 for all edges */
+  long long area = (x[1] - x[0])*(y[2] - y[0]) - (x[2] - x[0])*(y[1] - y[0]);
+  if(!area)
+    return;
+  if(area < 0){
+    std::swap(v[1], v[2]);
+    std::swap(tc[1], tc[2]);
+    std::swap(x[1], x[2]);
+    std::swap(y[1], y[2]);
+  }
+
+  BlockSetup bs;
+  setupEdge(bs.edges[0], x[0], y[0], x[1], y[1]);
+  setupEdge(bs.edges[1], x[1], y[1], x[2], y[2]);
+  setupEdge(bs.edges[2], x[2], y[2], x[0], y[0]);
+#if !defined(__AVX2__) && defined(__SSE2__)
+  for(int e=0; e<3; ++e){
+    int stepX = (int)bs.edges[e].stepX;
+    bs.edgeLanes[e] = _mm_setr_epi32(0, stepX, 2*stepX, 3*stepX);
+  }
+#endif
+
+  /* The planes use the unsnapped positions to stay close to the
+     attribute values the scanline engine interpolates */
+  float fx[3], fy[3];
+  for(int i=0; i<3; ++i){
+    fx[i] = (float)v[i].x * (1.0f / 65536.0f);
+    fy[i] = (float)v[i].y * (1.0f / 65536.0f);
+  }
+  /* Covered pixels can lie a fraction of a pixel outside the unsnapped
+     triangle. Clamping keeps the extrapolated depth inside the range of
+     the vertices, which the hierarchical Z test relies on. */
+  bs.zMin = (float)std::min(std::min(v[0].z, v[1].z), v[2].z);
+  bs.zMax = (float)std::max(std::max(v[0].z, v[1].z), v[2].z);
+  setupPlane(bs.z, fx[0], fy[0], (float)v[0].z, fx[1], fy[1], (float)v[1].z, fx[2], fy[2], (float)v[2].z);
+  setupPlane(bs.w, fx[0], fy[0], (float)v[0].w, fx[1], fy[1], (float)v[1].w, fx[2], fy[2], (float)v[2].w);
+  setupPlane(bs.s, fx[0], fy[0], (float)tc[0].x, fx[1], fy[1], (float)tc[1].x, fx[2], fy[2], (float)tc[2].x);
+  setupPlane(bs.t, fx[0], fy[0], (float)tc[0].y, fx[1], fy[1], (float)tc[1].y, fx[2], fy[2], (float)tc[2].y);
+
+  bs.texture = setup.texture;
+  bs.levels = setup.levels;
+  bs.mipFeedback = setup.mipFeedback;
+  bindLevel(bs, 0);
+
+  /* Pixel bounds, aligned down to the block grid. Blocks never straddle
+     a tile since the tile size is a multiple of the block size. */
+  const long long one = 1 << SUBPIXEL_BITS;
+  long long minX = std::min(std::min(x[0], x[1]), x[2]);
+  long long maxX = std::max(std::max(x[0], x[1]), x[2]);
+  long long minY = std::min(std::min(y[0], y[1]), y[2]);
+  long long maxY = std::max(std::max(y[0], y[1]), y[2]);
+  int px0 = (int)std::max<long long>((minX + one - 1) >> SUBPIXEL_BITS, clip.x0) & ~(BLOCK_W - 1);
+  int py0 = (int)std::max<long long>((minY + one - 1) >> SUBPIXEL_BITS, clip.y0) & ~(BLOCK_H - 1);
+  int px1 = (int)std::min<long long>(maxX >> SUBPIXEL_BITS, clip.x1);
+  int py1 = (int)std::min<long long>(maxY >> SUBPIXEL_BITS, clip.y1);
+
+  /* Largest offset from a block's top-left corner to its best pixel */
+  long long reach[3];
+  for(int e=0; e<3; ++e)
+    reach[e] = std::max(bs.edges[e].stepX, 0LL)*(BLOCK_W - 1) + std::max(bs.edges[e].stepY, 0LL)*(BLOCK_H - 1);
+
+  for(int by = py0; by <= py1; by += BLOCK_H){
+    /* Narrow the row to the blocks where every edge can be satisfied.
+       The edges are linear in x, so each one bounds the row on one side. */
+    long long rowValue[3];
+    int bx0 = px0;
+    int bx1 = px1;
+    for(int e=0; e<3; ++e){
+      const EdgeFunction& edge = bs.edges[e];
+      rowValue[e] = evalEdge(edge, 0, by);
+      long long best = rowValue[e] + reach[e];
+      if(edge.stepX > 0){
+	long long first = floorDiv(-best + edge.stepX - 1, edge.stepX);
+	bx0 = (int)std::max<long long>(bx0, first & ~(long long)(BLOCK_W - 1));
+      } else if(edge.stepX < 0){
+	bx1 = (int)std::min<long long>(bx1, floorDiv(best, -edge.stepX));
+      } else if(best < 0){
+	bx1 = bx0 - 1;
+      }
+    }
+
+    for(int bx = bx0; bx <= bx1; bx += BLOCK_W){
+      /* Trivial reject against each edge using the block's best corner */
+      bool outside = false;
+      int corner[3];
+      for(int e=0; e<3 && !outside; ++e){
+	long long value = rowValue[e] + bs.edges[e].stepX*bx;
+	outside = value + reach[e] < 0;
+	corner[e] = clampEdge(value);
+      }
+      if(outside)
+	continue;
+
+      if(mipmapping)
+	selectBlockLevel(bs, bx, by);
+
+#if defined(__AVX2__) || defined(__SSE2__)
+      if(bx >= clip.x0 && bx + BLOCK_W - 1 <= clip.x1 &&
+	 by >= clip.y0 && by + BLOCK_H - 1 <= clip.y1){
+	shadeBlock(bs, buffer, pitch, bx, by, corner);
+	continue;
+      }
+#endif
+      shadeBlockScalar(bs, buffer, pitch, clip, bx, by);
+    }
+  }
+}
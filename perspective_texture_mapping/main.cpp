@@ -1,7 +1,10 @@
-#include <SDL/SDL.h>
 #include <vector>
 #include <algorithm>
+#include <thread>
 #include <linealg.h>
+#include <vertexstream.h>
+#include <meshopt.h>
+#include <display.h>
 #include <il.h>
 #include <ilu.h>
 #include "clipplane.h"
@@ -9,65 +12,158 @@
 #include "rasterizer.h"
 #include "meshgen.h"
 #include "texture.h"
+#include "textureloader.h"
+#include "residency.h"
 #include "myassert.h"
 
 int main(int argc, char* argv[])
 {
-    (void)argc;
-    (void)argv;
-	
-    const int width = 640;
-    const int height = 360;
-    const int depth = 32;
-    bool running = true;
-    SDL_Event event;
-    std::vector<Vector4f> vertexData; /* Our original mesh */
-    std::vector<Vector4f> tcoordData; /* Our original mesh */
-    std::vector<Vector4f> workingCopyVertex;  /* Intermediate working copy */ 
-    std::vector<Vector4f> workingCopyTCoord;  /* Intermediate working copy */ 
+    DisplayOptions options(640, 360);
+    if(!ParseDisplayOptions(argc, argv, options))
+        return 1;
+    const int width = options.width;
+    const int height = options.height;
+    bool halfSpace = false;
+    bool hiZ = true;
+    bool guardBand = true;
+    bool mipmap = true;
+    bool bilinear = false;
+    bool textureSort = false;
+    unsigned int cullMode = CULL_BACK;
+    const char* cullNames[] = { "none", "back", "front" };
+    unsigned int spanMode = 0;
+    const unsigned int spanLengths[] = { 0, 8, 16, 32 };
+    unsigned int layoutMode = 0;
+    bool checkThreads = false;
+    const BufferLayout layouts[] = { BUFFER_LINEAR, BUFFER_TILED8, BUFFER_TILED16 };
+    const char* layoutNames[] = { "linear", "8x8 blocks", "16x16 blocks" };
+    IndexedMesh mesh;           /* Our original mesh */
+    VertexStream vertexStream;  /* Its unique vertices, SoA for the batch transform */
+    VertexStream clipStream;    /* Transformed vertices */
+    std::vector<unsigned short> outcodes; /* Frustum outcode of every transformed vertex */
+    std::vector<Vector4f> workingCopyVertex;  /* Transformed unique vertices */ 
+    std::vector<Vector4f> clippedVertex;      /* Output of the clipper, reused every frame */
+    std::vector<Vector4f> clippedTCoord;      /* Output of the clipper, reused every frame */
+    std::vector<unsigned int> clippedMaterial; /* Texture handle of every clipped triangle */
     std::vector<unsigned int> texBuf;   /* RGBA Texture image */
 
     ilInit();
     iluInit();
-    SDL_Init(SDL_INIT_VIDEO);
-    screen = SDL_SetVideoMode(width, height, depth, SDL_DOUBLEBUF | SDL_HWSURFACE);
-    SDL_WM_SetCaption("MechCore.net Projection Example", NULL);
+    Display* display = OpenDisplay(options, "MechCore.net Perspective Texture Mapping Example");
     
-    makeMeshCube(vertexData, tcoordData, 1.0f);
-    const Texture* texture = ReadPNG("texture0.png");
-    if(!texture){
-	printf("Couldn't load one or more texture maps.\n \
-Make sure you have copied the data from the source directory to the binary directory, or CWD.\n");
-	return -1;
-    }
-    BindTexture(texture);
-    /* Initialize our buffers */
+    makeMeshCube(mesh, 1.0f);
+    /* Reorder for the vertex cache and front-to-back drawing, and report how it went */
+    optimizeMesh(mesh, true, "Cube");
+    toVertexStream(mesh.vertices, vertexStream);
+    /* Draw in the byte order of the display, and initialize our buffers */
+    framebufferFormat = display->bgra() ? TEXTURE_BGRA8_PREMULTIPLIED : TEXTURE_RGBA8_PREMULTIPLIED;
     InitBuffers(width, height);
+    /* The texture file made by texconvert is paged in level by level as the
+       cube needs them. The PNG is the fallback, and drawing starts with a
+       placeholder while it loads. Both are converted to the pixel format
+       of the screen, so texels are written to it as they are. */
+    TextureHandle cubeTexture = AddManagedTexture("texture0.cgt", framebufferFormat);
+    if(cubeTexture == TEXTURE_HANDLE_NONE)
+	cubeTexture = StreamTexture("texture0.png", framebufferFormat);
+    /* The cube is closed, so its back faces can never win the depth test */
+    SetCullMode((CullMode)cullMode);
+    /* Rasterize screen tiles on every core */
+    SetRasterThreads(std::thread::hardware_concurrency());
 
-    while(running){
-        while(SDL_PollEvent(&event)){
-            switch(event.type)
-            {
-            case SDL_KEYDOWN:
-		if(event.key.keysym.sym == SDLK_ESCAPE){
-		    running = false;
+    while(display->running()){
+        int key;
+        while((key = display->pollKey()) != DISPLAY_KEY_NONE){
+		if(key == DISPLAY_KEY_ESCAPE)
+		    display->close();
+		/* Tab flips between the two rasterization engines */
+		if(key == DISPLAY_KEY_TAB){
+		    halfSpace = !halfSpace;
+		    SetRasterEngine(halfSpace ? RASTER_HALFSPACE : RASTER_SCANLINE);
+		}
+		/* H toggles hierarchical Z and reports what it culled */
+		if(key == 'h'){
+		    unsigned int triangles, spans;
+		    GetHierarchicalZStats(triangles, spans);
+		    if(hiZ)
+			printf("Hierarchical Z culled %u triangles and %u spans\n", triangles, spans);
+		    hiZ = !hiZ;
+		    SetHierarchicalZ(hiZ);
+		}
+		/* M toggles mipmapping */
+		if(key == 'm'){
+		    mipmap = !mipmap;
+		    SetMipmapping(mipmap);
+		    printf("Mipmapping %s\n", mipmap ? "on" : "off");
+		}
+		/* F switches between nearest and bilinear filtering */
+		if(key == 'f'){
+		    bilinear = !bilinear;
+		    SetTextureFilter(bilinear ? TEXTURE_BILINEAR : TEXTURE_NEAREST);
+		    printf("Bilinear filtering %s\n", bilinear ? "on" : "off");
+		}
+		/* S toggles drawing the triangles grouped by texture */
+		if(key == 's'){
+		    textureSort = !textureSort;
+		    SetTextureSort(textureSort);
+		    printf("Texture sorting %s\n", textureSort ? "on" : "off");
+		}
+		/* G switches between guard band and full x/y clipping */
+		if(key == 'g'){
+		    guardBand = !guardBand;
+		    printf("Guard band %s\n", guardBand ? "on" : "off");
+		}
+		/* B cycles the face culling mode */
+		if(key == 'b'){
+		    cullMode = (cullMode + 1) % 3;
+		    SetCullMode((CullMode)cullMode);
+		    printf("Culling %s faces\n", cullNames[cullMode]);
+		}
+		/* R reports texture residency */
+		if(key == 'r'){
+		    TextureResidencyStats stats;
+		    GetTextureResidencyStats(stats);
+		    printf("Textures: %u of %u levels, %u of %u KiB resident, %u misses, "
+			   "%u levels (%u KiB) paged in, %u evicted\n",
+			   stats.residentLevels, stats.totalLevels,
+			   (unsigned int)(stats.residentBytes >> 10), (unsigned int)(stats.budget >> 10),
+			   stats.misses, stats.loads, (unsigned int)(stats.bytesLoaded >> 10), stats.evictions);
+		}
+		/* L cycles the layout of the color and depth buffers */
+		if(key == 'l'){
+		    layoutMode = (layoutMode + 1) % 3;
+		    InitBuffers(width, height, layouts[layoutMode]);
+		    printf("Framebuffer layout %s\n", layoutNames[layoutMode]);
 		}
-		break;
-            case SDL_QUIT:
-                running = false;
-                break;
-            }
+		/* C reports how the triangles went through the clip stage */
+		if(key == 'c'){
+		    unsigned int accepted, rejected, clipped;
+		    GetClipStats(accepted, rejected, clipped);
+		    printf("Clipping: %u accepted, %u rejected, %u clipped, %u culled\n",
+			   accepted, rejected, clipped, GetCulledTriangles());
+		}
+		/* P cycles the perspective span length and reports how far the
+		   previous one strayed from the exact divide */
+		if(key == 'p'){
+		    if(spanLengths[spanMode])
+			printf("Span length %u: max texel error %u\n",
+			       spanLengths[spanMode], GetPerspectiveMaxError());
+		    spanMode = (spanMode + 1) % 4;
+		    SetPerspectiveSpan(spanLengths[spanMode]);
+		    SetPerspectiveErrorTracking(spanLengths[spanMode] != 0);
+		    GetPerspectiveMaxError();
+		}
+		/* T draws the next frame again on a single thread and reports
+		   whether the screen tiles gave the same image */
+		if(key == 't')
+		    checkThreads = true;
         }
 
-        float time_elapsed = (float)SDL_GetTicks() * 0.001f;
-        /* We need a new working copy every frame */
-        workingCopyVertex.resize(vertexData.size());
-	workingCopyTCoord.resize(tcoordData.size());
-	/* Copy our original data into the working copies */
-        std::copy(vertexData.begin(), vertexData.end(), workingCopyVertex.begin());
-        std::copy(tcoordData.begin(), tcoordData.end(), workingCopyTCoord.begin());
-	/* Make sure our buffers are of the same size */
-	ASSERT(workingCopyVertex.size() == workingCopyTCoord.size());
+        /* Swap in textures that finished loading, and the mip levels
+           the last frame asked for */
+        UpdateStreamedTextures();
+        UpdateTextureResidency();
+
+        float time_elapsed = (float)display->ticks() * 0.001f;
 
         /* world matrix transform */
 	float xOffset = 2.0f * std::sin(2.0f * M_PI * time_elapsed * 0.1f);
@@ -75,67 +171,83 @@ Make sure you have copied the data from the source directory to the binary direc
 	  rotateX(60.0f *   time_elapsed) * rotateY(60.0f *   time_elapsed) * rotateZ(60.0f * time_elapsed);
 	
 	/* perspective function is in linealg.h under /include */
-        Matrix4f clipMatrix = perspective(45.0f, 16.0f/9.0f, 1.0f, 10.0f);
+        Matrix4f clipMatrix = perspective(45.0f, (float)width/height, 1.0f, 10.0f);
 	Matrix4f worldClipMatrix = clipMatrix * worldMatrix;
 	
-        /* Transform our points */
-	for(unsigned int i=0; i<workingCopyVertex.size(); i+=3){
-	    Vector4f& p1 = workingCopyVertex[i];
-	    Vector4f& p2 = workingCopyVertex[i+1];
-	    Vector4f& p3 = workingCopyVertex[i+2];
-            p1 = worldClipMatrix * p1;
-	    p2 = worldClipMatrix * p2;
-	    p3 = worldClipMatrix * p3;
-	}
+	/* Triangles that stay inside the guard band are left for the rasterizer to scissor */
+	GuardBand guard;
+	if(guardBand)
+	    guard = GuardBand((float)RASTER_GUARD_BAND, (float)width, (float)height);
 
-	/* Clip against the six frustum planes */
-#if 1
-	clip_triangle(workingCopyVertex, workingCopyTCoord, Vector4f(-1.0f,  0.0f, 0.0f, 1.0f));
-	clip_triangle(workingCopyVertex, workingCopyTCoord, Vector4f( 1.0f,  0.0f, 0.0f, 1.0f));
-	clip_triangle(workingCopyVertex, workingCopyTCoord, Vector4f( 0.0f,  1.0f, 0.0f, 1.0f));
-        clip_triangle(workingCopyVertex, workingCopyTCoord, Vector4f( 0.0f, -1.0f, 0.0f, 1.0f));
-	clip_triangle(workingCopyVertex, workingCopyTCoord, Vector4f( 0.0f,  0.0f,-1.0f, 1.0f));
-	clip_triangle(workingCopyVertex, workingCopyTCoord, Vector4f( 0.0f,  0.0f, 1.0f, 1.0f));
-#endif	
-	ASSERT(workingCopyVertex.size() == workingCopyTCoord.size());
+        /* Transform each unique vertex once, several at a time, and unpack them for the clipper */
+        transformStream(worldClipMatrix, vertexStream, clipStream, outcodes, guard);
+        fromVertexStream(clipStream, workingCopyVertex);
+
+	/* Clip against near, far and the guard band planes. Every draw of the
+	   frame appends to the same lists, along with its texture handle. */
+	clippedVertex.clear();
+	clippedTCoord.clear();
+	clippedMaterial.clear();
+	clip_triangles_append(workingCopyVertex, outcodes, mesh, cubeTexture,
+			      clippedVertex, clippedTCoord, clippedMaterial, guard);
+	ASSERT(clippedVertex.size() == clippedTCoord.size());
+	ASSERT(clippedVertex.size() == clippedMaterial.size() * 3);
 	/* Assert that we have whole triangles after clipping */
-	ASSERT(!(workingCopyVertex.size() % 3));
+	ASSERT(!(clippedVertex.size() % 3));
 
-	for(unsigned int i=0; i<workingCopyVertex.size(); ++i)
+	/* Perspective divide and viewport mapping, several vertices at a time.
+	   projectStream does the same as project() in linealg.h under /include
+	   x and y is in screenspace
+	   z is normalized into [0,1> range
+	   w = 1.0 / w
+	*/
+	toVertexStream(clippedVertex, clipStream);
+	projectStream(clipStream, clipStream, (float)width, (float)height, guard);
+	for(unsigned int i=0; i<clippedVertex.size(); ++i)
 	{
-	    /* does not divide w by w */
-	    //workingCopyVertex[i] /= workingCopyVertex[i].w;
-	    float wInv = 1.0f / workingCopyVertex[i].w;
-	    workingCopyVertex[i].w = wInv;
-	    workingCopyVertex[i].x *= wInv;
-	    workingCopyVertex[i].y *= wInv;
-	    workingCopyVertex[i].z *= wInv;
-	    workingCopyTCoord[i].x *= wInv;
-	    workingCopyTCoord[i].y *= wInv;
-
-	    /* project function is in linealg.h under /include
-	       x and y is in screenspace
-	       z is normalized into [0,1> range
-	       w = 1.0 / w
-	    */
-	    workingCopyVertex[i] = project(workingCopyVertex[i], (float)width, (float)height);
-	    /* Store as fixedpoint. We want to interpolate 1/w across the edges.
-	       The interpolated 1/w is flipped again, that is w = 1.0 / (v0.w + t*(v1.w - v0.w))
-	       z is stored in the range [0.0, 1.0] inclusive. That is, 65535 = 1.0 */
+	    clippedVertex[i] = clipStream.get(i);
+	    /* Texture coordinates are interpolated premultiplied by 1/w */
+	    clippedTCoord[i].x *= clipStream.w[i];
+	    clippedTCoord[i].y *= clipStream.w[i];
 	}
 
-	SDL_LockSurface(screen);
-        unsigned int* pixels = static_cast<unsigned int*>(screen->pixels);
-	/* Clear our depth buffer */
-	ClearBuffer(DEPTH_BUFFER);
-        /* clear the screen to black */
-        memset(pixels, 0, sizeof(Uint32) * width * height);
-	/* Draw the triangles */
-	DrawTriangle(workingCopyVertex, workingCopyTCoord, pixels, width, height);
-	SDL_UnlockSurface(screen);
-	SDL_Flip(screen);
+        unsigned int pitch;
+        unsigned int* pixels = display->lock(pitch);
+	std::vector<unsigned int> threadedFrame;
+	for(int pass=0; pass<(checkThreads ? 2 : 1); ++pass){
+	    if(pass == 1){
+		for(int y=0; y<height; ++y)
+		    threadedFrame.insert(threadedFrame.end(), pixels + y*pitch, pixels + y*pitch + width);
+		SetRasterThreads(1);
+	    }
+	    /* Clear our depth buffer, and the screen to black. Both only mark
+	       the tiles, which are cleared as they are drawn into. */
+	    ClearBuffer(DEPTH_BUFFER);
+	    ClearBuffer(COLOR_BUFFER);
+	    if(layouts[layoutMode] == BUFFER_LINEAR){
+		/* Draw the triangles */
+		DrawTriangle(clippedVertex, clippedTCoord, clippedMaterial, pixels, width, height, pitch);
+		/* The tiles nothing was drawn into still need their black */
+		ResolveClear(COLOR_BUFFER, pixels, pitch);
+	    } else {
+		/* Draw into the tiled color buffer, then copy it to the screen */
+		DrawTriangle(clippedVertex, clippedTCoord, clippedMaterial,
+			     &colorbuffer.data[0], width, height, colorbuffer.pitch);
+		ResolveColorBuffer(pixels, pitch, framebufferFormat);
+	    }
+	}
+	if(checkThreads){
+	    unsigned int differing = 0;
+	    for(int y=0; y<height; ++y)
+		for(int x=0; x<width; ++x)
+		    differing += pixels[x + y*pitch] != threadedFrame[x + y*width];
+	    printf("Threaded and serial drawing differ in %u pixels\n", differing);
+	    SetRasterThreads(std::thread::hardware_concurrency());
+	    checkThreads = false;
+	}
+        display->present();
     }    
-    SDL_Quit();
+    delete display;
     return 0;
 }
 
@@ -12,6 +12,7 @@ Neither the name of the organization nor the names of its contributors may be us
 #ifndef MESHGEN_GUARD_H
 #define MESHGEN_GUARD_H
 #include <linealg.h>
+#include <mesh.h>
 
 void makeMeshSphere(std::vector<Vector4f>& dst, float radius);
 void makeMeshCircle(std::vector<Vector4f>& dst, float radius);
@@ -21,4 +22,9 @@ void makeMeshPlane(std::vector<Vector4f>& vertexData,
 void makeMeshCube(std::vector<Vector4f>& vertexData,
 		  std::vector<Vector4f>& tcoordData,
 		  float size);
+/* Indexed versions of the above, every shared corner stored once */
+void makeMeshSphere(IndexedMesh& mesh, float radius);
+void makeMeshCircle(IndexedMesh& mesh, float radius);
+void makeMeshPlane(IndexedMesh& mesh, float size);
+void makeMeshCube(IndexedMesh& mesh, float size);
 #endif
@@ -0,0 +1,269 @@
+#include "pngdecode.h"
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <zlib.h>
+
+/* What IHDR, PLTE and tRNS said about the image */
+struct PNGInfo
+{
+    unsigned int width;
+    unsigned int height;
+    unsigned int depth;          /* Bits per sample */
+    unsigned int colorType;
+    unsigned int bytesPerPixel;  /* Filter distance, at least 1 */
+    size_t rowBytes;             /* Without the filter type byte */
+    unsigned int palette[256];   /* RGBA8, opaque black past the PLTE entries */
+    bool hasKey;                 /* tRNS of a gray or RGB image */
+    unsigned int key[3];         /* The transparent sample values */
+};
+
+/* Ends the inflate stream however the decode exits */
+struct Inflater
+{
+    z_stream stream;
+    bool started;
+
+    Inflater() : started(false) { memset(&stream, 0, sizeof(stream)); }
+    ~Inflater() { if(started) inflateEnd(&stream); }
+};
+
+static unsigned int readBE32(const unsigned char* p)
+{
+    return ((unsigned int)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static bool readHeader(const unsigned char* body, unsigned int length, PNGInfo& png)
+{
+    if(length != 13)
+        return false;
+    png.width = readBE32(body);
+    png.height = readBE32(body + 4);
+    png.depth = body[8];
+    png.colorType = body[9];
+    /* Compression, filter method and interlacing. Adam7 is left to DevIL. */
+    if(body[10] || body[11] || body[12])
+        return false;
+    if(!png.width || !png.height || (unsigned long long)png.width * png.height > (1u << 28))
+        return false;
+
+    unsigned int channels;
+    bool depthOk;
+    bool pow2 = png.depth && !(png.depth & (png.depth - 1));
+    switch(png.colorType){
+    case 0: channels = 1; depthOk = pow2 && png.depth <= 16; break;
+    case 3: channels = 1; depthOk = pow2 && png.depth <= 8; break;
+    case 2: channels = 3; depthOk = png.depth == 8 || png.depth == 16; break;
+    case 4: channels = 2; depthOk = png.depth == 8 || png.depth == 16; break;
+    case 6: channels = 4; depthOk = png.depth == 8 || png.depth == 16; break;
+    default: return false;
+    }
+    if(!depthOk)
+        return false;
+    unsigned int bitsPerPixel = channels * png.depth;
+    png.bytesPerPixel = (bitsPerPixel + 7) / 8;
+    png.rowBytes = ((size_t)png.width * bitsPerPixel + 7) / 8;
+    for(int i=0; i<256; ++i)
+        png.palette[i] = 0xFF000000;
+    png.hasKey = false;
+    return true;
+}
+
+static unsigned char paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if(pa <= pb && pa <= pc)
+        return a;
+    return pb <= pc ? b : c;
+}
+
+/* Undoes the filter of one row in place. 'prior' is the row above,
+   already unfiltered, and all zeros for the first row. */
+static bool unfilterRow(unsigned char* row, const unsigned char* prior, size_t count,
+                        unsigned int bpp, unsigned char filter)
+{
+    switch(filter){
+    case 0:
+        return true;
+    case 1:
+        for(size_t i=bpp; i<count; ++i)
+            row[i] += row[i - bpp];
+        return true;
+    case 2:
+        for(size_t i=0; i<count; ++i)
+            row[i] += prior[i];
+        return true;
+    case 3:
+        for(size_t i=0; i<bpp; ++i)
+            row[i] += prior[i] >> 1;
+        for(size_t i=bpp; i<count; ++i)
+            row[i] += (row[i - bpp] + prior[i]) >> 1;
+        return true;
+    case 4:
+        for(size_t i=0; i<bpp; ++i)
+            row[i] += prior[i];
+        for(size_t i=bpp; i<count; ++i)
+            row[i] += paeth(row[i - bpp], prior[i], prior[i - bpp]);
+        return true;
+    }
+    return false;
+}
+
+/* Sample 'index' of a row, as stored */
+static unsigned int sample(const unsigned char* row, size_t index, unsigned int depth)
+{
+    if(depth == 8)
+        return row[index];
+    if(depth == 16)
+        return (row[2*index] << 8) | row[2*index + 1];
+    size_t bit = index * depth;
+    return (row[bit >> 3] >> (8 - depth - (bit & 7))) & ((1u << depth) - 1);
+}
+
+/* A sample as stored, scaled to 8 bits */
+static unsigned int to8(unsigned int value, unsigned int depth)
+{
+    if(depth == 16)
+        return value >> 8;
+    return value * (255 / ((1u << depth) - 1));
+}
+
+static unsigned int rgba(unsigned int r, unsigned int g, unsigned int b, unsigned int a)
+{
+    return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+/* One unfiltered row to RGBA8 texels */
+static void expandRow(const unsigned char* row, unsigned int* texels, const PNGInfo& png)
+{
+    unsigned int depth = png.depth;
+    switch(png.colorType){
+    case 0:
+        for(unsigned int x=0; x<png.width; ++x){
+            unsigned int v = sample(row, x, depth);
+            unsigned int g = to8(v, depth);
+            texels[x] = rgba(g, g, g, png.hasKey && v == png.key[0] ? 0 : 255);
+        }
+        break;
+    case 2:
+        if(depth == 8 && !png.hasKey){
+            for(unsigned int x=0; x<png.width; ++x, row+=3)
+                texels[x] = rgba(row[0], row[1], row[2], 255);
+            break;
+        }
+        for(unsigned int x=0; x<png.width; ++x){
+            unsigned int r = sample(row, 3*x, depth);
+            unsigned int g = sample(row, 3*x + 1, depth);
+            unsigned int b = sample(row, 3*x + 2, depth);
+            bool key = png.hasKey && r == png.key[0] && g == png.key[1] && b == png.key[2];
+            texels[x] = rgba(to8(r, depth), to8(g, depth), to8(b, depth), key ? 0 : 255);
+        }
+        break;
+    case 3:
+        for(unsigned int x=0; x<png.width; ++x)
+            texels[x] = png.palette[sample(row, x, depth)];
+        break;
+    case 4:
+        for(unsigned int x=0; x<png.width; ++x){
+            unsigned int g = to8(sample(row, 2*x, depth), depth);
+            texels[x] = rgba(g, g, g, to8(sample(row, 2*x + 1, depth), depth));
+        }
+        break;
+    default:
+        if(depth == 8){
+            for(unsigned int x=0; x<png.width; ++x, row+=4)
+                texels[x] = rgba(row[0], row[1], row[2], row[3]);
+            break;
+        }
+        for(unsigned int x=0; x<png.width; ++x)
+            texels[x] = rgba(row[8*x], row[8*x + 2], row[8*x + 4], row[8*x + 6]);
+        break;
+    }
+}
+
+bool DecodePNG(const unsigned char* data, size_t size, Texture& texture)
+{
+    static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    if(size < 8 || memcmp(data, signature, 8))
+        return false;
+
+    PNGInfo png = PNGInfo();
+    Inflater inflater;
+    z_stream& stream = inflater.stream;
+    std::vector<unsigned char> rows;  /* Each filtered row after its filter type */
+    bool header = false, end = false;
+    size_t pos = 8;
+    while(!end){
+        if(size - pos < 12)
+            return false;
+        unsigned int length = readBE32(data + pos);
+        const unsigned char* type = data + pos + 4;
+        const unsigned char* body = type + 4;
+        if(length > size - pos - 12 || readBE32(body + length) != crc32(crc32(0, Z_NULL, 0), type, length + 4))
+            return false;
+        pos += length + 12;
+
+        if(!memcmp(type, "IHDR", 4)){
+            if(header || !readHeader(body, length, png))
+                return false;
+            header = true;
+            rows.resize((png.rowBytes + 1) * png.height);
+            if(inflateInit(&stream) != Z_OK)
+                return false;
+            inflater.started = true;
+            stream.next_out = &rows[0];
+            stream.avail_out = rows.size();
+        } else if(!header){
+            return false;
+        } else if(!memcmp(type, "PLTE", 4)){
+            if(length % 3 || length > 3*256)
+                return false;
+            for(unsigned int i=0; i<length/3; ++i)
+                png.palette[i] = rgba(body[3*i], body[3*i + 1], body[3*i + 2], 255);
+        } else if(!memcmp(type, "tRNS", 4)){
+            if(png.colorType == 3){
+                for(unsigned int i=0; i<length && i<256; ++i)
+                    png.palette[i] = (png.palette[i] & 0xFFFFFF) | (body[i] << 24);
+            } else if((png.colorType == 0 && length >= 2) || (png.colorType == 2 && length >= 6)){
+                png.hasKey = true;
+                for(unsigned int i=0; i<length/2 && i<3; ++i)
+                    png.key[i] = (body[2*i] << 8) | body[2*i + 1];
+            }
+        } else if(!memcmp(type, "IDAT", 4)){
+            stream.next_in = (Bytef*)body;
+            stream.avail_in = length;
+            while(stream.avail_in){
+                int result = inflate(&stream, Z_NO_FLUSH);
+                if(result == Z_STREAM_END)
+                    break;
+                if(result != Z_OK)
+                    return false;
+            }
+        } else if(!memcmp(type, "IEND", 4)){
+            end = true;
+        } else if(!(type[0] & 0x20)){
+            /* A critical chunk this doesn't know */
+            return false;
+        }
+    }
+    if(stream.total_out != rows.size())
+        return false;
+
+    TexelVector texels((size_t)png.width * png.height);
+    std::vector<unsigned char> zeros(png.rowBytes, 0);
+    const unsigned char* prior = &zeros[0];
+    for(unsigned int y=0; y<png.height; ++y){
+        unsigned char* row = &rows[y * (png.rowBytes + 1)];
+        if(!unfilterRow(row + 1, prior, png.rowBytes, png.bytesPerPixel, row[0]))
+            return false;
+        expandRow(row + 1, &texels[(size_t)(png.height - 1 - y) * png.width], png);
+        prior = row + 1;
+    }
+
+    texture.width = png.width;
+    texture.height = png.height;
+    texture.color.swap(texels);
+    texture.format = TEXTURE_RGBA8;
+    return true;
+}
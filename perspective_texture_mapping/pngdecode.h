@@ -0,0 +1,29 @@
+/*
+Copyright (c) 2013, Mads Andreas Elvheim
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+*/
+
+
+#ifndef PNGDECODE_H_GUARD
+#define PNGDECODE_H_GUARD
+#include <cstddef>
+#include "texture.h"
+
+/* Decodes a PNG file held in memory into level 0 of 'texture', in
+   TEXTURE_RGBA8 with the bottom row first, the way ReadPNG has always
+   had its images. Every color type and bit depth is read, and tRNS
+   becomes the alpha. 16-bit samples keep their high byte, and gamma is
+   left alone.
+
+   All of its state is local, so any number of threads can decode at
+   once. Returns false on anything that isn't a PNG it reads, including
+   interlaced ones, and leaves the texture as it was. */
+bool DecodePNG(const unsigned char* data, size_t size, Texture& texture);
+
+#endif
@@ -1,9 +1,14 @@
 #include <vector>
 #include <cstdio>
-#include <SDL/SDL.h>
+#include <memory>
+#include <atomic>
+#include <cstdlib>
+#include <climits>
 #include <linealg.h>
 #include <fixedpoint.h>
+#include <threadpool.h>
 #include "rasterizer.h"
+#include "rastersetup.h"
 #include "framebuffer.h"
 #include "texture.h"
 #include "myassert.h"
@@ -13,9 +18,208 @@ inline int fpceil(int fp)
   return (fp & 65535) ? ((fp & ~65535) + 65536) : fp;
 }
 
+/* A tile's pending clears are written by the thread that draws the tile,
+   which is only race free while clear tiles and raster tiles coincide */
+static_assert((1 << CLEAR_TILE_SHIFT) == RASTER_TILE_SIZE,
+	      "lazy clear tiles must be the raster tiles");
+
+static std::unique_ptr<ThreadPool> rasterPool;
+static std::vector<TriangleSetup> triangleSetups;
+static std::vector< std::vector<unsigned int> > tileBins;
+static void (*rasterizeFunc)(const TriangleSetup&, unsigned int*, unsigned int, const ClipRect&) = RasterizeTriangleScanline;
+static int perspectiveSpan = 0;
+static bool perspectiveErrorTracking = false;
+static std::atomic<unsigned int> perspectiveMaxError(0);
+static std::atomic<unsigned int> hizTrianglesCulled(0);
+static std::atomic<unsigned int> hizSpansCulled(0);
+bool hierarchicalZ = true;
+bool mipmapping = true;
+bool bilinearFiltering = false;
+static bool textureSort = false;
+/* Addressing of every mip level of every texture, indexed by handle.
+   Set up once per DrawTriangle call. */
+static std::vector< std::vector<TexelAddress> > textureLevels;
+static std::vector<TriangleSetup> sortedSetups;
+/* Mip levels asked for per texture handle, see GetMipFeedback. Atomics
+   can't live in a vector, which would move them when it grows. */
+static std::unique_ptr< std::atomic<unsigned int>[] > mipFeedback;
+static unsigned int mipFeedbackSize = 0;
+
+/* Moves an interpolant forward by a number of whole steps. Same result as
+   adding the slope 'steps' times, which keeps clipped spans bit-exact. */
+inline void skipSteps(int& value, int slope, int steps)
+{
+  value = (int)((unsigned int)value + (unsigned int)slope * (unsigned int)steps);
+}
+
+/* x slope of an edge in Q16. With the guard band an edge can be thousands
+   of pixels wide while less than a pixel tall, which does not fit in an
+   int. Such an edge spans at most one row, and saturating keeps that row
+   inside the edge's x range. */
+inline int edgeSlopeX(int deltaX, int deltaY)
+{
+  long long slope = ((long long)deltaX << 16) / deltaY;
+  return (int)std::max<long long>(std::min<long long>(slope, INT_MAX), INT_MIN);
+}
+
+/* Texel coordinates in Q16 from the interpolated 1/w, s/w and t/w.
+   Same arithmetic as the exact per-pixel path. */
+template<bool Pow2>
+inline void perspectiveTexel(int wInv, int sw, int tw,
+			     const TexelAddress& address,
+			     int& sTex, int& tTex)
+{
+  int w = 0x100000000LL / wInv;
+  int s = ((long long)w * sw) >> 16;
+  int t = ((long long)w * tw) >> 16;
+  sTex = address.scaleS<Pow2>(s);
+  tTex = address.scaleT<Pow2>(t);
+}
+
+inline void trackPerspectiveError(unsigned int error)
+{
+  unsigned int current = perspectiveMaxError;
+  while(error > current && !perspectiveMaxError.compare_exchange_weak(current, error))
+    ;
+}
+
+/* Inner loop of drawScanLine, with the exact divide at every pixel.
+   The address is taken by value so the compiler knows the color buffer
+   writes can't change it, and keeps it in registers. cbuffer and zbuffer
+   point at the start of the row, 'shift' is the layout of both. The span
+   before scissoring, spanStart to spanEnd, is only used when subdividing. */
+template<bool Pow2, TextureLayout Layout, bool Bilinear, bool Tiled>
+static bool drawSpanExact(unsigned int* cbuffer, unsigned short* zbuffer,
+			  TexelAddress address,
+			  unsigned int shift, int xStart, int xEnd,
+			  int zStart, int wStart, int sStart, int tStart,
+			  int slopeZ, int slopeW, int slopeS, int slopeT,
+			  int zMin, int zMax, int, int)
+{
+  bool wrote = false;
+  for(; xStart <= xEnd; ++xStart){
+    unsigned short z = std::min(std::max(zStart, zMin), zMax);
+    unsigned int col = PixelColumn<Tiled>(xStart, shift);
+    if(z < zbuffer[col]){
+      zbuffer[col] = z;
+      int w = 0x100000000LL / wStart;
+      int s = ((long long)w * sStart)  >> 16;
+      int t = ((long long)w * tStart)  >> 16;
+      cbuffer[col] = address.sample<Pow2, Layout, Bilinear>(address.scaleS<Pow2>(s),
+							    address.scaleT<Pow2>(t));
+      wrote = true;
+    }
+    zStart += slopeZ;
+    wStart += slopeW;
+    sStart += slopeS;
+    tStart += slopeT;
+  }
+  return wrote;
+}
+
+/* Span subdivided version of the inner loop in drawScanLine.
+   The exact divide is only done at every 'perspectiveSpan' pixels and
+   s and t are stepped linearly in texel space in between. The last span
+   of a line ends on the last pixel rather than one past it, so 1/w is
+   never extrapolated beyond the edge of the triangle. The spans are laid
+   out from spanStart to spanEnd, the line before scissoring, so that
+   every screen tile divides it at the same pixels. */
+template<bool Pow2, TextureLayout Layout, bool Bilinear, bool Tiled>
+static bool drawSpansSubdivided(unsigned int* cbuffer, unsigned short* zbuffer,
+				TexelAddress address,
+				unsigned int shift, int xStart, int xEnd,
+				int zStart, int wStart, int sStart, int tStart,
+				int slopeZ, int slopeW, int slopeS, int slopeT,
+				int zMin, int zMax, int spanStart, int spanEnd)
+{
+  /* Pixels from the start of the span holding xStart */
+  int offset = (xStart - spanStart) % perspectiveSpan;
+  int sTex, tTex;
+  unsigned int maxError = 0;
+  bool wrote = false;
+
+  {
+    int wFirst = wStart, sFirst = sStart, tFirst = tStart;
+    skipSteps(wFirst, slopeW, -offset);
+    skipSteps(sFirst, slopeS, -offset);
+    skipSteps(tFirst, slopeT, -offset);
+    perspectiveTexel<Pow2>(wFirst, sFirst, tFirst, address, sTex, tTex);
+  }
+  while(xStart <= xEnd){
+    int remaining = spanEnd - xStart + offset + 1;
+    int count = std::min(remaining, perspectiveSpan);
+    int steps = (count == remaining) ? count - 1 : count;
+    int sTexEnd = sTex, tTexEnd = tTex;
+    int stepS = 0, stepT = 0;
+
+    if(steps > 0){
+      int wEnd = wStart, sEnd = sStart, tEnd = tStart;
+      skipSteps(wEnd, slopeW, steps - offset);
+      skipSteps(sEnd, slopeS, steps - offset);
+      skipSteps(tEnd, slopeT, steps - offset);
+      perspectiveTexel<Pow2>(wEnd, sEnd, tEnd, address, sTexEnd, tTexEnd);
+      stepS = (sTexEnd - sTex) / steps;
+      stepT = (tTexEnd - tTex) / steps;
+    }
+    sTex += stepS * offset;
+    tTex += stepT * offset;
+    count = std::min(count - offset, xEnd - xStart + 1);
+
+    for(int i=0; i<count; ++i){
+      unsigned short z = std::min(std::max(zStart, zMin), zMax);
+      unsigned int col = PixelColumn<Tiled>(xStart, shift);
+      if(z < zbuffer[col]){
+	zbuffer[col] = z;
+	cbuffer[col] = address.sample<Pow2, Layout, Bilinear>(sTex, tTex);
+	wrote = true;
+	if(perspectiveErrorTracking){
+	  int sExact, tExact;
+	  perspectiveTexel<Pow2>(wStart, sStart, tStart, address, sExact, tExact);
+	  maxError = std::max<unsigned int>(maxError, std::abs((sTex >> 16) - (sExact >> 16)));
+	  maxError = std::max<unsigned int>(maxError, std::abs((tTex >> 16) - (tExact >> 16)));
+	}
+      }
+      ++xStart;
+      sTex += stepS;
+      tTex += stepT;
+      zStart += slopeZ;
+      wStart += slopeW;
+      sStart += slopeS;
+      tStart += slopeT;
+    }
+    /* Snap back onto the exact value so the error never accumulates */
+    sTex = sTexEnd;
+    tTex = tTexEnd;
+    offset = 0;
+  }
+
+  if(maxError)
+    trackPerspectiveError(maxError);
+  return wrote;
+}
+
+typedef bool (*SpanFunction)(unsigned int*, unsigned short*, TexelAddress, unsigned int, int, int,
+			     int, int, int, int, int, int, int, int, int, int, int, int);
+
+/* Indexed by a tiled framebuffer, bilinearFiltering, TexelAddress::pow2
+   and TexelAddress::layout */
+#define SPAN_LAYOUTS(f, pow2, bilinear, tiled) \
+  { f<pow2, TEXTURE_LINEAR, bilinear, tiled>, f<pow2, TEXTURE_TILED, bilinear, tiled>, \
+    f<pow2, TEXTURE_BC1, bilinear, tiled> }
+#define SPAN_FILTERS(f, tiled) \
+  { { SPAN_LAYOUTS(f, false, false, tiled), SPAN_LAYOUTS(f, true, false, tiled) }, \
+    { SPAN_LAYOUTS(f, false, true, tiled), SPAN_LAYOUTS(f, true, true, tiled) } }
+#define SPAN_TABLE(f) { SPAN_FILTERS(f, false), SPAN_FILTERS(f, true) }
+static const SpanFunction spansExact[2][2][2][3] = SPAN_TABLE(drawSpanExact);
+static const SpanFunction spansSubdivided[2][2][2][3] = SPAN_TABLE(drawSpansSubdivided);
+#undef SPAN_TABLE
+#undef SPAN_FILTERS
+#undef SPAN_LAYOUTS
+
 static void drawScanLine(unsigned int* cbuffer,
-		  int width,
-		  int height,
+		  const TriangleSetup& setup,
+		  int pitch,
+		  const ClipRect& clip,
 		  int y,
 		  int x1, int x2,
 		  int z1, int z2,
@@ -24,17 +228,11 @@ static void drawScanLine(unsigned int* cbuffer,
 		  int t1, int t2)
 {
   unsigned short* zbuffer;
-  unsigned short z;
   int deltaX, deltaZ, deltaW, deltaS, deltaT;
   int slopeZ, slopeW, slopeS, slopeT;
   int zStart, zEnd, wStart, wEnd, sStart, sEnd, tStart, tEnd;
   int xError;
-  int w, s, t;
-  int texWidth, texHeight;
   int xStart, xEnd;
-  int col;
-
-  col = y*width;
 
   if(x1 > x2){
     std::swap(x1, x2);
@@ -79,53 +277,70 @@ static void drawScanLine(unsigned int* cbuffer,
   sStart += ((long long)slopeS * xError)>>16;
   tStart += ((long long)slopeT * xError)>>16;  
 
-  zbuffer = &depthbuffer.data[col];
-  const unsigned int* texture = &currentTexture->color[0];
-  texWidth = currentTexture->width;
-  texHeight = currentTexture->height;
-  
-  int indexDst = xStart + col;    
-  int indexSrc;
-  for(; xStart <= xEnd; ++xStart){
-    z = zStart;
-    if(z < zbuffer[xStart]){
-      zbuffer[xStart] = z;
-      w = 0x100000000LL / wStart;
-      s = ((long long)w * sStart)  >> 16;
-      t = ((long long)w * tStart)  >> 16;
-      s = ((long long)s * (texWidth - 1));
-      t = ((long long)t * (texHeight - 1));
-      s >>= 16;
-      t >>= 16;
-      indexSrc = s + t*texWidth;
-      cbuffer[indexDst] = texture[indexSrc];      
+  /* One mip level for the whole span, picked at its middle pixel before
+     scissoring so that every screen tile agrees on it */
+  int wMid = wStart, sMid = sStart, tMid = tStart;
+  int half = (xEnd - xStart) / 2;
+  skipSteps(wMid, slopeW, half);
+  skipSteps(sMid, slopeS, half);
+  skipSteps(tMid, slopeT, half);
+  int spanStart = xStart, spanEnd = xEnd;
+
+  /* Scissor against the clip rectangle */
+  if(xStart < clip.x0){
+    int skip = clip.x0 - xStart;
+    skipSteps(zStart, slopeZ, skip);
+    skipSteps(wStart, slopeW, skip);
+    skipSteps(sStart, slopeS, skip);
+    skipSteps(tStart, slopeT, skip);
+    xStart = clip.x0;
+  }
+  if(xEnd > clip.x1)
+    xEnd = clip.x1;
+
+  if(xStart > xEnd)
+    return;
+
+  /* Hierarchical Z. z is linear along the span, so the smallest value is
+     at one of the ends, and the span functions clamp it to the vertex
+     range like every pixel. */
+  if(hierarchicalZ){
+    int zLast = zStart;
+    skipSteps(zLast, slopeZ, xEnd - xStart);
+    int zNear = std::min(std::max(std::min(zStart, zLast), setup.minZ), setup.maxZ);
+    if(zNear >= DepthPyramidSpanMax(y, xStart, xEnd)){
+      ++hizSpansCulled;
+      return;
     }
-    ++indexDst;
-    zStart += slopeZ;
-    wStart += slopeW;
-    sStart += slopeS;
-    tStart += slopeT;
   }
-}
 
-void DrawTriangle(std::vector<Vector4f>& vertexData,
-		  std::vector<Vector4f>& textureData,
-		  unsigned int* buffer,
-		  unsigned int width,
-		  unsigned int height
-		  )
-{
-  //  const float eps = 0.00001f;
-  for(int i=0; i<vertexData.size(); i+=3){
-    Vector4f& v1 = vertexData[i+0];
-    Vector4f& v2 = vertexData[i+1];
-    Vector4f& v3 = vertexData[i+2];
+  unsigned int level = SelectMipLevel(setup.texture, *setup.mipFeedback,
+				      (float)wMid, (float)sMid, (float)tMid, setup.wdx, setup.wdy, setup.sdx, setup.sdy, setup.tdx, setup.tdy);
+  const TexelAddress& address = setup.levels[level];
 
-    Vector4f& tc1 = textureData[i+0];
-    Vector4f& tc2 = textureData[i+1];
-    Vector4f& tc3 = textureData[i+2];
+  unsigned int shift = depthbuffer.shift;
+  zbuffer = &depthbuffer.data[depthbuffer.index(0, y)];
+  SpanFunction drawSpan = perspectiveSpan ?
+    spansSubdivided[shift != 0][bilinearFiltering][address.pow2][address.layout] :
+    spansExact[shift != 0][bilinearFiltering][address.pow2][address.layout];
+  if(drawSpan(cbuffer + PixelIndex(0, y, pitch, shift), zbuffer, address, shift, xStart, xEnd,
+	      zStart, wStart, sStart, tStart,
+	      slopeZ, slopeW, slopeS, slopeT, setup.minZ, setup.maxZ,
+	      spanStart, spanEnd) && hierarchicalZ)
+    MarkDepthDirty(y, xStart, xEnd);
+}
 
+inline void planeGradient(const Vector4f& v1, const Vector4f& v2, const Vector4f& v3,
+			  float a1, float a2, float a3, float detInv, float& dx, float& dy)
+{
+  dx = ((a2 - a1)*(v3.y - v1.y) - (a3 - a1)*(v2.y - v1.y)) * detInv;
+  dy = ((a3 - a1)*(v2.x - v1.x) - (a2 - a1)*(v3.x - v1.x)) * detInv;
+}
 
+static bool SetupTriangle(Vector4f v1, Vector4f v2, Vector4f v3,
+			  Vector4f tc1, Vector4f tc2, Vector4f tc3,
+			  TriangleSetup& setup)
+{
     /* deltas below are always positive due to this sorting. v1 = top, v2 = middle, v3 = bottom */
     if(v1.y > v2.y){
       std::swap(v1, v2);
@@ -141,13 +356,45 @@ void DrawTriangle(std::vector<Vector4f>& vertexData,
     }
 
     /* Q15.16 fixedpoint values*/
-    Vector4i v1fp(v1.x * 65536.0f, v1.y * 65536.0f, v1.z * 65535.0f, v1.w * 65536.0f);
-    Vector4i v2fp(v2.x * 65536.0f, v2.y * 65536.0f, v2.z * 65535.0f, v2.w * 65536.0f);
-    Vector4i v3fp(v3.x * 65536.0f, v3.y * 65536.0f, v3.z * 65535.0f, v3.w * 65536.0f);
+    setup.v1fp = Vector4i(v1.x * 65536.0f, v1.y * 65536.0f, v1.z * 65535.0f, v1.w * 65536.0f);
+    setup.v2fp = Vector4i(v2.x * 65536.0f, v2.y * 65536.0f, v2.z * 65535.0f, v2.w * 65536.0f);
+    setup.v3fp = Vector4i(v3.x * 65536.0f, v3.y * 65536.0f, v3.z * 65535.0f, v3.w * 65536.0f);
+
+    setup.tc1fp = Vector4i(tc1.x * 65536.0f, tc1.y * 65536.0f, 0.0f, 0.0f);
+    setup.tc2fp = Vector4i(tc2.x * 65536.0f, tc2.y * 65536.0f, 0.0f, 0.0f);
+    setup.tc3fp = Vector4i(tc3.x * 65536.0f, tc3.y * 65536.0f, 0.0f, 0.0f);
 
-    Vector4i tc1fp(tc1.x * 65536.0f, tc1.y * 65536.0f, 0.0f, 0.0f);
-    Vector4i tc2fp(tc2.x * 65536.0f, tc2.y * 65536.0f, 0.0f, 0.0f);
-    Vector4i tc3fp(tc3.x * 65536.0f, tc3.y * 65536.0f, 0.0f, 0.0f);
+    setup.minY = fpceil(setup.v1fp.y) >> 16;
+    setup.maxY = (fpceil(setup.v3fp.y) - 65536) >> 16;
+    setup.minX = (std::min(std::min(setup.v1fp.x, setup.v2fp.x), setup.v3fp.x) >> 16) - 1;
+    setup.maxX = (std::max(std::max(setup.v1fp.x, setup.v2fp.x), setup.v3fp.x) >> 16) + 1;
+    setup.minZ = std::min(std::min(setup.v1fp.z, setup.v2fp.z), setup.v3fp.z);
+    setup.maxZ = std::max(std::max(setup.v1fp.z, setup.v2fp.z), setup.v3fp.z);
+
+    /* Gradients of the plane through the three vertices */
+    float det = (v2.x - v1.x)*(v3.y - v1.y) - (v3.x - v1.x)*(v2.y - v1.y);
+    float detInv = det != 0.0f ? 1.0f / det : 0.0f;
+    planeGradient(v1, v2, v3, (float)setup.v1fp.w, (float)setup.v2fp.w, (float)setup.v3fp.w,
+		  detInv, setup.wdx, setup.wdy);
+    planeGradient(v1, v2, v3, (float)setup.tc1fp.x, (float)setup.tc2fp.x, (float)setup.tc3fp.x,
+		  detInv, setup.sdx, setup.sdy);
+    planeGradient(v1, v2, v3, (float)setup.tc1fp.y, (float)setup.tc2fp.y, (float)setup.tc3fp.y,
+		  detInv, setup.tdx, setup.tdy);
+
+    return setup.minY <= setup.maxY;
+}
+
+void RasterizeTriangleScanline(const TriangleSetup& setup,
+			       unsigned int* buffer,
+			       unsigned int pitch,
+			       const ClipRect& clip)
+{
+    const Vector4i& v1fp = setup.v1fp;
+    const Vector4i& v2fp = setup.v2fp;
+    const Vector4i& v3fp = setup.v3fp;
+    const Vector4i& tc1fp = setup.tc1fp;
+    const Vector4i& tc2fp = setup.tc2fp;
+    const Vector4i& tc3fp = setup.tc3fp;
 
     Vector4i delta1PTfp = v2fp - v1fp;
     Vector4i delta2PTfp = v3fp - v1fp;
@@ -176,7 +423,7 @@ void DrawTriangle(std::vector<Vector4f>& vertexData,
     slope1T = slope2T = slope3T = 0;
 
     if(delta1PTfp.y > 0){
-      slope1X = ((long long)delta1PTfp.x << 16) / delta1PTfp.y;
+      slope1X = edgeSlopeX(delta1PTfp.x, delta1PTfp.y);
       slope1Z = ((long long)delta1PTfp.z << 16) / delta1PTfp.y;
       slope1W = ((long long)delta1PTfp.w << 16) / delta1PTfp.y;
       slope1S = ((long long)delta1TCfp.x << 16) / delta1PTfp.y;
@@ -184,7 +431,7 @@ void DrawTriangle(std::vector<Vector4f>& vertexData,
     }
 
     if(delta2PTfp.y > 0){
-      slope2X = ((long long)delta2PTfp.x << 16) / delta2PTfp.y;
+      slope2X = edgeSlopeX(delta2PTfp.x, delta2PTfp.y);
       slope2Z = ((long long)delta2PTfp.z << 16) / delta2PTfp.y;
       slope2W = ((long long)delta2PTfp.w << 16) / delta2PTfp.y;
       slope2S = ((long long)delta2TCfp.x << 16) / delta2PTfp.y;
@@ -192,7 +439,7 @@ void DrawTriangle(std::vector<Vector4f>& vertexData,
     }
 
     if(delta3PTfp.y > 0){
-      slope3X = ((long long)delta3PTfp.x << 16) / delta3PTfp.y;
+      slope3X = edgeSlopeX(delta3PTfp.x, delta3PTfp.y);
       slope3Z = ((long long)delta3PTfp.z << 16) / delta3PTfp.y;
       slope3W = ((long long)delta3PTfp.w << 16) / delta3PTfp.y;
       slope3S = ((long long)delta3TCfp.x << 16) / delta3PTfp.y;
@@ -231,9 +478,26 @@ void DrawTriangle(std::vector<Vector4f>& vertexData,
 
     y1 >>= 16;
     y2 >>= 16;
+    /* Scissor rows against the clip rectangle */
+    if(y1 < clip.y0){
+      int skip = clip.y0 - y1;
+      skipSteps(x1, slope1X, skip);
+      skipSteps(x2, slope2X, skip);
+      skipSteps(z1, slope1Z, skip);
+      skipSteps(z2, slope2Z, skip);
+      skipSteps(w1, slope1W, skip);
+      skipSteps(w2, slope2W, skip);
+      skipSteps(s1, slope1S, skip);
+      skipSteps(s2, slope2S, skip);
+      skipSteps(t1, slope1T, skip);
+      skipSteps(t2, slope2T, skip);
+      y1 = clip.y0;
+    }
+    if(y2 > clip.y1)
+      y2 = clip.y1;
     /* Skipped if delta1f.y < 1 */
     for(; y1<=y2; ++y1){
-      drawScanLine(buffer, width, height, y1, x1, x2, z1, z2, w1, w2, s1, s2, t1, t2);
+      drawScanLine(buffer, setup, pitch, clip, y1, x1, x2, z1, z2, w1, w2, s1, s2, t1, t2);
       z1 += slope1Z;
       z2 += slope2Z;
       w1 += slope1W;
@@ -283,9 +547,26 @@ void DrawTriangle(std::vector<Vector4f>& vertexData,
     
     y1 >>= 16;
     y2 >>= 16;
+    /* Scissor rows against the clip rectangle */
+    if(y1 < clip.y0){
+      int skip = clip.y0 - y1;
+      skipSteps(x1, slope3X, skip);
+      skipSteps(x2, slope2X, skip);
+      skipSteps(z1, slope3Z, skip);
+      skipSteps(z2, slope2Z, skip);
+      skipSteps(w1, slope3W, skip);
+      skipSteps(w2, slope2W, skip);
+      skipSteps(s1, slope3S, skip);
+      skipSteps(s2, slope2S, skip);
+      skipSteps(t1, slope3T, skip);
+      skipSteps(t2, slope2T, skip);
+      y1 = clip.y0;
+    }
+    if(y2 > clip.y1)
+      y2 = clip.y1;
     /* Never iterated if delta3f.y < 1 */
     for(; y1<=y2; ++y1){
-      drawScanLine(buffer, width, height, y1, x1, x2, z1, z2, w1, w2, s1, s2, t1, t2);
+      drawScanLine(buffer, setup, pitch, clip, y1, x1, x2, z1, z2, w1, w2, s1, s2, t1, t2);
       z1 += slope3Z;
       z2 += slope2Z;
       w1 += slope3W;
@@ -297,5 +578,213 @@ void DrawTriangle(std::vector<Vector4f>& vertexData,
       x1 += slope3X; /* bottom - middle */
       x2 += slope2X; /* bottom - top */
     }
+}
+
+/* Hierarchical Z test ahead of the slope setup */
+static bool TriangleOccluded(const TriangleSetup& setup, const ClipRect& clip)
+{
+  int x0 = std::max(setup.minX, clip.x0);
+  int y0 = std::max(setup.minY, clip.y0);
+  int x1 = std::min(setup.maxX, clip.x1);
+  int y1 = std::min(setup.maxY, clip.y1);
+  if(x0 > x1 || y0 > y1)
+    return false;
+
+  RefreshDepthPyramid(x0, y0, x1, y1);
+  if(setup.minZ < DepthPyramidMax(x0, y0, x1, y1))
+    return false;
+  ++hizTrianglesCulled;
+  return true;
+}
+
+/* Runs the selected engine on one triangle, unless hierarchical Z
+   proves it hidden inside the clip rectangle. The tiles it may touch
+   get their pending clears first. They lie inside the clip rectangle,
+   so with threads every tile is only cleared by its owner. */
+static void DrawSetup(const TriangleSetup& setup, unsigned int* buffer,
+		      unsigned int pitch, const ClipRect& clip)
+{
+  if(hierarchicalZ && TriangleOccluded(setup, clip))
+    return;
+  int x0 = std::max(setup.minX, clip.x0);
+  int y0 = std::max(setup.minY, clip.y0);
+  int x1 = std::min(setup.maxX, clip.x1);
+  int y1 = std::min(setup.maxY, clip.y1);
+  if(x0 > x1 || y0 > y1)
+    return;
+  ResolveTileClears(x0, y0, x1, y1, buffer, pitch);
+  rasterizeFunc(setup, buffer, pitch, clip);
+}
+
+static void BinTriangles(unsigned int tilesX, unsigned int tilesY)
+{
+  for(size_t i=0; i<tileBins.size(); ++i)
+    tileBins[i].clear();
+  tileBins.resize(tilesX * tilesY);
+
+  /* Bins are filled in submission order, so every tile sees its triangles
+     in the same order as the serial path. That keeps depth ties identical. */
+  for(unsigned int i=0; i<triangleSetups.size(); ++i){
+    const TriangleSetup& setup = triangleSetups[i];
+    int tx0 = std::max(setup.minX, 0) / RASTER_TILE_SIZE;
+    int ty0 = std::max(setup.minY, 0) / RASTER_TILE_SIZE;
+    int tx1 = std::min<int>(std::max(setup.maxX, 0) / RASTER_TILE_SIZE, tilesX - 1);
+    int ty1 = std::min<int>(std::max(setup.maxY, 0) / RASTER_TILE_SIZE, tilesY - 1);
+    for(int ty=ty0; ty<=ty1; ++ty)
+      for(int tx=tx0; tx<=tx1; ++tx)
+	tileBins[tx + ty*tilesX].push_back(i);
+  }
+}
+
+void SetRasterThreads(unsigned int count)
+{
+  if(count > 1)
+    rasterPool.reset(new ThreadPool(count - 1));
+  else
+    rasterPool.reset();
+}
+
+void SetPerspectiveSpan(unsigned int spanLength)
+{
+  perspectiveSpan = spanLength;
+}
+
+void SetPerspectiveErrorTracking(bool enable)
+{
+  perspectiveErrorTracking = enable;
+}
+
+unsigned int GetPerspectiveMaxError()
+{
+  return perspectiveMaxError.exchange(0);
+}
+
+void SetMipmapping(bool enable)
+{
+  mipmapping = enable;
+}
+
+void SetTextureFilter(TextureFilter filter)
+{
+  bilinearFiltering = filter == TEXTURE_BILINEAR;
+}
+
+void SetTextureSort(bool enable)
+{
+  textureSort = enable;
+}
+
+unsigned int GetMipFeedback(unsigned int handle)
+{
+  return handle < mipFeedbackSize ? mipFeedback[handle].exchange(0) : 0;
+}
+
+void SetHierarchicalZ(bool enable)
+{
+  hierarchicalZ = enable;
+}
+
+void GetHierarchicalZStats(unsigned int& trianglesCulled, unsigned int& spansCulled)
+{
+  trianglesCulled = hizTrianglesCulled.exchange(0);
+  spansCulled = hizSpansCulled.exchange(0);
+}
+
+void SetRasterEngine(RasterEngine engine)
+{
+  switch(engine)
+  {
+  case RASTER_SCANLINE:
+    rasterizeFunc = RasterizeTriangleScanline;
+    break;
+  case RASTER_HALFSPACE:
+    rasterizeFunc = RasterizeTriangleHalfSpace;
+    break;
+  }
+}
+
+/* Groups the triangle setups by texture handle with a counting sort,
+   which keeps the submission order within each texture */
+static void SortByTexture()
+{
+  std::vector<unsigned int> start(textureLevels.size() + 1, 0);
+  for(size_t i=0; i<triangleSetups.size(); ++i)
+    ++start[triangleSetups[i].textureHandle + 1];
+  for(size_t i=1; i<start.size(); ++i)
+    start[i] += start[i - 1];
+
+  sortedSetups.resize(triangleSetups.size());
+  for(size_t i=0; i<triangleSetups.size(); ++i)
+    sortedSetups[start[triangleSetups[i].textureHandle]++] = triangleSetups[i];
+  triangleSetups.swap(sortedSetups);
+}
+
+void DrawTriangle(std::vector<Vector4f>& vertexData,
+		  std::vector<Vector4f>& textureData,
+		  const std::vector<unsigned int>& materials,
+		  unsigned int* buffer,
+		  unsigned int width,
+		  unsigned int height,
+		  unsigned int pitch
+		  )
+{
+  textureLevels.resize(TextureHandleCount());
+  if(mipFeedbackSize < textureLevels.size()){
+    std::unique_ptr< std::atomic<unsigned int>[] > grown(new std::atomic<unsigned int>[textureLevels.size()]);
+    for(unsigned int i=0; i<textureLevels.size(); ++i)
+      grown[i] = i < mipFeedbackSize ? mipFeedback[i].load() : 0;
+    mipFeedback.swap(grown);
+    mipFeedbackSize = textureLevels.size();
+  }
+  for(unsigned int handle=0; handle<textureLevels.size(); ++handle){
+    const Texture* texture = GetTexture(handle);
+    textureLevels[handle].resize(texture ? texture->levels.size() : 0);
+    for(unsigned int i=0; i<textureLevels[handle].size(); ++i)
+      textureLevels[handle][i] = GetTexelAddress(*texture, i);
   }
+
+  triangleSetups.clear();
+  for(unsigned int i=0; i<vertexData.size(); i+=3){
+    /* Triangles without a texture are dropped */
+    TextureHandle handle = materials[i / 3];
+    if(handle >= textureLevels.size() || textureLevels[handle].empty())
+      continue;
+    TriangleSetup setup;
+    if(SetupTriangle(vertexData[i+0], vertexData[i+1], vertexData[i+2],
+		     textureData[i+0], textureData[i+1], textureData[i+2], setup)){
+      setup.textureHandle = handle;
+      setup.texture = GetTexture(handle);
+      setup.levels = &textureLevels[handle][0];
+      setup.mipFeedback = &mipFeedback[handle];
+      triangleSetups.push_back(setup);
+    }
+  }
+  if(textureSort)
+    SortByTexture();
+
+  if(!rasterPool){
+    ClipRect screenRect = { 0, 0, (int)width - 1, (int)height - 1 };
+    for(unsigned int i=0; i<triangleSetups.size(); ++i)
+      DrawSetup(triangleSetups[i], buffer, pitch, screenRect);
+    return;
+  }
+
+  /* Sort-middle: bin by screen tile, then rasterize the tiles in parallel.
+     Tiles never overlap, so the workers share the color and depth buffers
+     without locking. */
+  unsigned int tilesX = (width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+  unsigned int tilesY = (height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+  BinTriangles(tilesX, tilesY);
+
+  rasterPool->parallelFor(tilesX * tilesY, [&](unsigned int tile)
+  {
+    const std::vector<unsigned int>& bin = tileBins[tile];
+    ClipRect tileRect;
+    tileRect.x0 = (tile % tilesX) * RASTER_TILE_SIZE;
+    tileRect.y0 = (tile / tilesX) * RASTER_TILE_SIZE;
+    tileRect.x1 = std::min<int>(tileRect.x0 + RASTER_TILE_SIZE, width) - 1;
+    tileRect.y1 = std::min<int>(tileRect.y0 + RASTER_TILE_SIZE, height) - 1;
+    for(size_t i=0; i<bin.size(); ++i)
+      DrawSetup(triangleSetups[bin[i]], buffer, pitch, tileRect);
+  });
 }
@@ -13,12 +13,94 @@ Neither the name of the organization nor the names of its contributors may be us
 #define RASTERIZER_H_GUARD
 #include <linealg.h>
 
+/* Side length in pixels of the screen tiles used by the threaded path.
+   The lazy clears in framebuffer.h use the same tiles. */
+#define RASTER_TILE_SIZE 64
+
+/* Pixels beyond each screen edge that triangles may reach without being
+   clipped. Both engines scissor to the screen, but spans and edge deltas
+   are Q15.16, so the viewport plus both bands must stay below 32768
+   pixels. That leaves room for screens up to 16383 pixels wide. */
+#define RASTER_GUARD_BAND 8192
+
+/* Number of threads DrawTriangle may use, including the caller.
+   0 or 1 selects the serial path. The threaded path bins triangles into
+   screen tiles and gives the exact same result as the serial one. */
+void SetRasterThreads(unsigned int count);
+
+enum RasterEngine
+{
+    RASTER_SCANLINE=0, /* Edge walker with per-pixel spans */
+    RASTER_HALFSPACE   /* Edge functions over SIMD pixel blocks */
+};
+
+/* Both engines take the same Q15.16 input and write 16-bit depth,
+   so they can be switched at any time for A/B comparisons. */
+void SetRasterEngine(RasterEngine engine);
+
+/* Perspective correction in the scanline engine. With a span length of 0
+   s and t are divided by w at every pixel. Otherwise the divide is done
+   every spanLength pixels (8, 16 or 32 are sensible) and s and t are
+   interpolated linearly in between. */
+void SetPerspectiveSpan(unsigned int spanLength);
+
+/* While enabled, the subdivided path also computes the exact texel for
+   every pixel it writes and records the largest distance in texels.
+   GetPerspectiveMaxError() returns that maximum and resets it. */
+void SetPerspectiveErrorTracking(bool enable);
+unsigned int GetPerspectiveMaxError();
+
+/* Mipmapping, on by default. Both engines pick a level of the bound
+   texture's mip chain from the texture coordinate derivatives, once per
+   span in the scanline engine and once per pixel block in the half-space
+   engine. Minified surfaces then read a smaller level instead of skipping
+   across level 0, which both aliases and misses the cache. */
+void SetMipmapping(bool enable);
+
+/* Levels of the full mip chain of a texture that the engines asked for
+   since the last call, one bit per level. Levels that a partly resident
+   texture doesn't hold (see Texture::firstLevel) are included, and
+   sampled at the finest level it does hold. */
+unsigned int GetMipFeedback(unsigned int handle);
+
+enum TextureFilter
+{
+    TEXTURE_NEAREST=0, /* One texel per pixel */
+    TEXTURE_BILINEAR   /* Weighted average of the four nearest texels */
+};
+
+/* Texture filter of both engines, nearest by default. Bilinear reads
+   four texels and blends the channels with 8-bit weights from the
+   fraction of the texel position. It combines with mipmapping, which
+   still picks a single level. */
+void SetTextureFilter(TextureFilter filter);
+
+/* Hierarchical Z, on by default. Triangles are tested against the depth
+   pyramid before their slopes are set up, and scanline spans before they
+   are walked. Only work that could not pass the depth test is skipped,
+   so the image is the same either way. The stats count culled triangles
+   and spans since the last call. */
+void SetHierarchicalZ(bool enable);
+void GetHierarchicalZStats(unsigned int& trianglesCulled, unsigned int& spansCulled);
+
+/* Draws the triangles of one DrawTriangle call grouped by texture,
+   off by default. Within a texture they keep their order. Fewer texture
+   switches keep each tile's texture working set in cache, but draws
+   no longer follow submission order, so depth ties and hierarchical Z
+   culling can come out differently. */
+void SetTextureSort(bool enable);
+
+/* Draws a triangle list. materials holds the texture handle of every
+   triangle, see AddTexture. Triangles whose handle names no texture are
+   skipped. Rows of buffer are 'pitch' pixels apart. */
 void DrawTriangle(
 		  std::vector<Vector4f>& vertexData,
 		  std::vector<Vector4f>& textureData,
+		  const std::vector<unsigned int>& materials,
 		  unsigned int* buffer,
 		  unsigned int width,
-		  unsigned int height
+		  unsigned int height,
+		  unsigned int pitch
 		  );
 void TriangleSplit(
 		   std::vector<Vector4f>& vertexData,
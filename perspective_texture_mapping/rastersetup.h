@@ -0,0 +1,123 @@
+/*
+Copyright (c) 2013, Mads Andreas Elvheim
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+*/
+
+#ifndef RASTERSETUP_H_GUARD
+#define RASTERSETUP_H_GUARD
+#include <cmath>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <linealg.h>
+#include "texture.h"
+
+/* Shared between the rasterization engines. Not part of the public
+   rasterizer interface. */
+
+/* Inclusive pixel rectangle the rasterizer is allowed to touch.
+   The serial path uses the whole screen, the tiled path one tile. */
+struct ClipRect
+{
+  int x0, y0;
+  int x1, y1;
+};
+
+/* A triangle after fixedpoint conversion and y-sorting.
+   v1 = top, v2 = middle, v3 = bottom. The bounds are in whole pixels and
+   padded by one pixel to cover rounding in the edge walkers. */
+struct TriangleSetup
+{
+  Vector4i v1fp, v2fp, v3fp;
+  Vector4i tc1fp, tc2fp, tc3fp;
+  int minX, minY;
+  int maxX, maxY;
+  /* Range of the vertex depths. The engines clamp interpolated depth to
+     it, so no pixel is nearer than the nearest vertex, which the
+     hierarchical Z test relies on. */
+  int minZ, maxZ;
+  /* Screen space gradients of the Q16 1/w, s/w and t/w, for mip selection */
+  float wdx, wdy;
+  float sdx, sdy;
+  float tdx, tdy;
+  /* Texture of the triangle, the addressing of each of its mip levels
+     and where the levels it asks for are recorded */
+  TextureHandle textureHandle;
+  const Texture* texture;
+  const TexelAddress* levels;
+  std::atomic<unsigned int>* mipFeedback;
+};
+
+/* Engines mark the depth pyramid dirty when this is set */
+extern bool hierarchicalZ;
+
+/* Engines sample level 0 only when this is cleared */
+extern bool mipmapping;
+
+/* Engines blend the 2x2 texel footprint when this is set */
+extern bool bilinearFiltering;
+
+/* Marks a level of the full mip chain as asked for. The bit is usually
+   set already, and reading first keeps the cache line shared. */
+inline void RecordMipFeedback(std::atomic<unsigned int>& feedback, int level)
+{
+  unsigned int bit = 1u << std::min(std::max(level, 0), 31);
+  if(!(feedback.load(std::memory_order_relaxed) & bit))
+    feedback.fetch_or(bit, std::memory_order_relaxed);
+}
+
+/* Mip level for a pixel with the interpolated 1/w, s/w and t/w given in
+   w, s and t, and their screen space gradients. The texel footprint is
+   the longer of the x and y derivatives of the level 0 texel position,
+   and the level is log2 of it rounded to nearest. Units cancel, so any
+   common scale of w, s and t works. The level wanted is recorded in
+   'feedback' before it is clamped to the levels the texture has. */
+inline unsigned int SelectMipLevel(const Texture* texture, std::atomic<unsigned int>& feedback,
+				   float w, float s, float t,
+				   float wdx, float wdy, float sdx, float sdy, float tdx, float tdy)
+{
+  /* Without mipmapping the full size level is the one wanted */
+  int level = -(int)texture->firstLevel;
+  if(mipmapping){
+    level = 0;
+    if(w > 0.0f){
+      float wInv = 1.0f / w;
+      float u = s * wInv, v = t * wInv;
+      float scaleS = (float)(texture->width - 1) * wInv;
+      float scaleT = (float)(texture->height - 1) * wInv;
+      float dudx = (sdx - u*wdx) * scaleS, dvdx = (tdx - v*wdx) * scaleT;
+      float dudy = (sdy - u*wdy) * scaleS, dvdy = (tdy - v*wdy) * scaleT;
+      float rho2 = std::max(dudx*dudx + dvdx*dvdx, dudy*dudy + dvdy*dvdy);
+
+      /* floor(log2(rho) + 0.5) = floor(log2(2*rho^2) / 2) */
+      int exponent;
+      std::frexp(2.0f * rho2, &exponent);
+      level = (exponent - 1) >> 1;
+    }
+  }
+  RecordMipFeedback(feedback, level + (int)texture->firstLevel);
+  return (unsigned int)std::min(std::max(level, 0), (int)texture->levels.size() - 1);
+}
+
+/* The engines draw into 'buffer', with rows 'pitch' pixels apart, and
+   into depthbuffer with its own pitch */
+
+/* Scanline engine, rasterizer.cpp */
+void RasterizeTriangleScanline(const TriangleSetup& setup,
+			       unsigned int* buffer,
+			       unsigned int pitch,
+			       const ClipRect& clip);
+
+/* Half-space engine, halfspace.cpp */
+void RasterizeTriangleHalfSpace(const TriangleSetup& setup,
+				unsigned int* buffer,
+				unsigned int pitch,
+				const ClipRect& clip);
+
+#endif
@@ -0,0 +1,170 @@
+#include "residency.h"
+#include "rasterizer.h"
+#include "texturefile.h"
+#include <vector>
+#include <algorithm>
+
+struct ManagedTexture
+{
+    const Texture* source;              /* The whole mip chain, mapped from the file */
+    Texture* resident;                  /* Copy of levels firstResident and up, one
+                                           allocation per level */
+    TextureHandle handle;
+    TextureFormat format;               /* Format of the resident copy */
+    unsigned int firstResident;
+    unsigned int wanted;                /* Finest level asked for in the last update */
+    std::vector<unsigned int> lastUsed; /* Update in which each level was last asked for */
+};
+
+static std::vector<ManagedTexture> managedTextures;
+static size_t textureBudget = 64 << 20;
+static size_t residentBytes = 0;
+static unsigned int residencyUpdate = 0;
+static unsigned int residencyMisses = 0;
+static unsigned int residencyLoads = 0;
+static unsigned int residencyEvictions = 0;
+static size_t residencyBytesLoaded = 0;
+
+static size_t textureBytes(const Texture* texture)
+{
+    size_t words = 0;
+    for(size_t i=0; i<texture->levelColor.size(); ++i)
+        words += texture->levelColor[i].size();
+    return words * sizeof(unsigned int);
+}
+
+/* Pages levels in or out one at a time until the resident copy starts
+   at 'firstLevel'. Only the levels that change are copied or freed. */
+static void setFirstResident(ManagedTexture& managed, unsigned int firstLevel)
+{
+    while(managed.firstResident > firstLevel){
+        --managed.firstResident;
+        PushTextureLevel(*managed.resident, *managed.source, managed.firstResident);
+        residentBytes += TextureLevelBytes(*managed.source, managed.firstResident);
+    }
+    while(managed.firstResident < firstLevel){
+        residentBytes -= TextureLevelBytes(*managed.source, managed.firstResident);
+        PopTextureLevel(*managed.resident);
+        ++managed.firstResident;
+    }
+}
+
+/* Drops the finest level of other textures, least recently used first,
+   until 'bytes' more fit in the budget. Levels asked for in this update
+   are kept, so textures in view don't push each other out. */
+static bool makeRoom(size_t bytes, const ManagedTexture* keep)
+{
+    while(residentBytes + bytes > textureBudget){
+        ManagedTexture* victim = NULL;
+        for(size_t i=0; i<managedTextures.size(); ++i){
+            ManagedTexture& managed = managedTextures[i];
+            if(&managed == keep || managed.firstResident + 1 >= managed.source->levels.size())
+                continue;
+            unsigned int used = managed.lastUsed[managed.firstResident];
+            if(used < residencyUpdate && (!victim || used < victim->lastUsed[victim->firstResident]))
+                victim = &managed;
+        }
+        if(!victim)
+            return false;
+        setFirstResident(*victim, victim->firstResident + 1);
+        ++residencyEvictions;
+    }
+    return true;
+}
+
+void SetTextureBudget(size_t bytes)
+{
+    textureBudget = bytes;
+}
+
+TextureHandle AddManagedTexture(const std::string& name, TextureFormat format)
+{
+    const Texture* source = MapTextureFile(name);
+    if(!source)
+        return TEXTURE_HANDLE_NONE;
+
+    ManagedTexture managed;
+    managed.source = source;
+    managed.format = format;
+    managed.firstResident = source->levels.size() - 1;
+    managed.wanted = managed.firstResident;
+    managed.resident = new Texture;
+    managed.resident->format = format;
+    PushTextureLevel(*managed.resident, *source, managed.firstResident);
+    managed.handle = AddTexture(managed.resident);
+    managed.lastUsed.assign(source->levels.size(), 0);
+    residentBytes += textureBytes(managed.resident);
+    managedTextures.push_back(managed);
+    return managed.handle;
+}
+
+void RemoveManagedTexture(TextureHandle handle)
+{
+    for(size_t i=0; i<managedTextures.size(); ++i){
+        ManagedTexture& managed = managedTextures[i];
+        if(managed.handle != handle)
+            continue;
+        RemoveTexture(handle);
+        residentBytes -= textureBytes(managed.resident);
+        DeleteTexture(managed.resident);
+        DeleteTexture(managed.source);
+        managedTextures.erase(managedTextures.begin() + i);
+        return;
+    }
+}
+
+void UpdateTextureResidency()
+{
+    ++residencyUpdate;
+    for(size_t i=0; i<managedTextures.size(); ++i){
+        ManagedTexture& managed = managedTextures[i];
+        unsigned int feedback = GetMipFeedback(managed.handle);
+        managed.wanted = managed.firstResident;
+        for(unsigned int level=0; level<managed.lastUsed.size(); ++level){
+            if(!(feedback & (1u << level)))
+                continue;
+            managed.lastUsed[level] = residencyUpdate;
+            managed.wanted = std::min(managed.wanted, level);
+        }
+        if(managed.wanted < managed.firstResident)
+            ++residencyMisses;
+    }
+
+    /* Missing levels come in from coarse to fine, so a texture that
+       doesn't fit completely still gets as close as the budget allows */
+    for(size_t i=0; i<managedTextures.size(); ++i){
+        ManagedTexture& managed = managedTextures[i];
+        unsigned int first = managed.firstResident;
+        size_t bytes = 0;
+        while(first > managed.wanted){
+            size_t levelBytes = TextureLevelBytes(*managed.source, first - 1);
+            if(!makeRoom(bytes + levelBytes, &managed))
+                break;
+            bytes += levelBytes;
+            --first;
+            ++residencyLoads;
+        }
+        if(first != managed.firstResident){
+            setFirstResident(managed, first);
+            residencyBytesLoaded += bytes;
+        }
+    }
+}
+
+void GetTextureResidencyStats(TextureResidencyStats& stats)
+{
+    stats.budget = textureBudget;
+    stats.residentBytes = residentBytes;
+    stats.residentLevels = 0;
+    stats.totalLevels = 0;
+    for(size_t i=0; i<managedTextures.size(); ++i){
+        stats.residentLevels += managedTextures[i].resident->levels.size();
+        stats.totalLevels += managedTextures[i].source->levels.size();
+    }
+    stats.misses = residencyMisses;
+    stats.loads = residencyLoads;
+    stats.evictions = residencyEvictions;
+    stats.bytesLoaded = residencyBytesLoaded;
+    residencyMisses = residencyLoads = residencyEvictions = 0;
+    residencyBytesLoaded = 0;
+}
@@ -0,0 +1,59 @@
+/*
+Copyright (c) 2013, Mads Andreas Elvheim
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+*/
+
+
+#ifndef RESIDENCY_H_GUARD
+#define RESIDENCY_H_GUARD
+#include <string>
+#include <cstddef>
+#include "texture.h"
+
+/* Keeps texture files partly in memory, within a byte budget. A managed
+   texture is mapped from its file, and its handle names a copy of the
+   small end of its mip chain. Every update reads the mip feedback of the
+   rasterizer: levels that were asked for but are missing get copied in
+   from the mapping, and when that would go over the budget the least
+   recently used levels of other textures are dropped. Until a level is
+   in, the finest resident level is drawn instead. The smallest level of
+   each texture stays resident no matter the budget. */
+
+/* Bytes of texels the managed textures may keep, 64 MiB by default.
+   Only enforced as levels are paged in. */
+void SetTextureBudget(size_t bytes);
+
+/* Starts managing a texture file from texconvert, with only its smallest
+   level resident. Levels are converted to 'format' as they are paged in,
+   which is free when the file is in that format already. Returns
+   TEXTURE_HANDLE_NONE if the file can't be mapped. */
+TextureHandle AddManagedTexture(const std::string& name, TextureFormat format);
+/* Removes the handle and frees the texture */
+void RemoveManagedTexture(TextureHandle handle);
+
+/* Pages levels in and out from the feedback of the frames drawn since
+   the last call. Call it between frames, from the thread that draws. */
+void UpdateTextureResidency();
+
+struct TextureResidencyStats
+{
+    size_t budget;
+    size_t residentBytes;
+    unsigned int residentLevels;
+    unsigned int totalLevels;
+    /* Counted since the last GetTextureResidencyStats call */
+    unsigned int misses;    /* Times a texture was asked for a level it lacked */
+    unsigned int loads;     /* Levels paged in */
+    unsigned int evictions; /* Levels dropped */
+    size_t bytesLoaded;
+};
+
+void GetTextureResidencyStats(TextureResidencyStats& stats);
+
+#endif
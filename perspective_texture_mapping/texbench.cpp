@@ -0,0 +1,151 @@
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <il.h>
+#include <ilu.h>
+#include "texture.h"
+
+/* Samples a texture in the tiled layout and as BC1 the way a rotated,
+   scaled quad would, and reports the texture memory each version
+   touches and how fast it samples. The memory touched is counted in
+   64-byte cache lines, which is what a cold cache has to fetch.
+
+   Usage: texbench [image], a procedural 1024x1024 texture without one */
+
+#define SCREEN_W 640
+#define SCREEN_H 360
+#define FRAMES 20
+
+static Texture* proceduralTexture(unsigned int size)
+{
+    Texture* texture = new Texture;
+    texture->width = texture->height = size;
+    texture->color.resize(size * size);
+    for(unsigned int y=0; y<size; ++y){
+        for(unsigned int x=0; x<size; ++x){
+            /* Smooth color ramps with sharp edged bricks on top */
+            unsigned int r = x * 255 / size, g = y * 255 / size;
+            unsigned int b = (unsigned int)(127.5f + 127.5f * std::sin(x * 0.05f) * std::cos(y * 0.03f));
+            bool mortar = (y % 32) < 2 || ((x + (y / 32 % 2) * 32) % 64) < 2;
+            if(mortar)
+                r = g = b = 200;
+            texture->color[x + y*size] = r | (g << 8) | (b << 16) | 0xFF000000;
+        }
+    }
+    BuildMipChain(*texture);
+    return texture;
+}
+
+/* Texel coordinates of screen pixel (x, y) on a quad rotated by 30
+   degrees, with 'scale' texels per pixel */
+struct Mapping
+{
+    float du, dv;
+    float scale;
+
+    explicit Mapping(float s) : du(std::cos(0.5236f) * s), dv(std::sin(0.5236f) * s), scale(s) {}
+    int s(int x, int y) const { return (int)(x*du - y*dv + 100000.0f) & 0x7FFFFFFF; }
+    int t(int x, int y) const { return (int)(x*dv + y*du + 100000.0f) & 0x7FFFFFFF; }
+};
+
+template<TextureLayout Layout>
+static double sampleFrames(const TexelAddress& address, const Mapping& mapping,
+                           std::vector<unsigned int>& screen)
+{
+    int sizeS = address.maxS + 1, sizeT = address.maxT + 1;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(int frame=0; frame<FRAMES; ++frame)
+        for(int y=0; y<SCREEN_H; ++y)
+            for(int x=0; x<SCREEN_W; ++x)
+                screen[x + y*SCREEN_W] = address.fetch<false, Layout>(mapping.s(x, y) % sizeS,
+                                                                      mapping.t(x, y) % sizeT);
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/* Distinct cache lines one frame reads from the level */
+static size_t touchedBytes(const TexelAddress& address, const Mapping& mapping)
+{
+    std::vector<bool> lines;
+    size_t count = 0;
+    int sizeS = address.maxS + 1, sizeT = address.maxT + 1;
+    for(int y=0; y<SCREEN_H; ++y){
+        for(int x=0; x<SCREEN_W; ++x){
+            unsigned int i = address.index(mapping.s(x, y) % sizeS, mapping.t(x, y) % sizeT);
+            size_t byte = address.layout == TEXTURE_BC1 ? (i >> 4) * 8 : i * 4;
+            size_t line = byte / 64;
+            if(line >= lines.size())
+                lines.resize(line + 1, false);
+            if(!lines[line]){
+                lines[line] = true;
+                ++count;
+            }
+        }
+    }
+    return count * 64;
+}
+
+static double psnr(const TexelAddress& a, const TexelAddress& b)
+{
+    double error = 0.0;
+    for(int t=0; t<=a.maxT; ++t){
+        for(int s=0; s<=a.maxS; ++s){
+            unsigned int x = a.fetch(s, t), y = b.fetch(s, t);
+            for(int shift=0; shift<24; shift+=8){
+                double d = (double)((x >> shift) & 255) - (double)((y >> shift) & 255);
+                error += d * d;
+            }
+        }
+    }
+    error /= 3.0 * (a.maxS + 1) * (a.maxT + 1);
+    return error > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / error) : 99.0;
+}
+
+int main(int argc, char* argv[])
+{
+    Texture* raw;
+    if(argc > 1){
+        ilInit();
+        iluInit();
+        raw = const_cast<Texture*>(ReadPNG(argv[1], TEXTURE_LINEAR));
+        if(!raw){
+            printf("Couldn't load %s\n", argv[1]);
+            return -1;
+        }
+    } else {
+        raw = proceduralTexture(1024);
+    }
+    SetTextureLayout(*raw, TEXTURE_TILED);
+
+    Texture* bc1 = new Texture(*raw);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    SetTextureLayout(*bc1, TEXTURE_BC1);
+    double encodeTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    TexelAddress rawAddress = GetTexelAddress(*raw, 0);
+    TexelAddress bc1Address = GetTexelAddress(*bc1, 0);
+    printf("%ux%u, %u levels\n", raw->width, raw->height, (unsigned int)raw->levels.size());
+    printf("All levels, tiled: %u KiB, BC1: %u KiB, encoded in %.1f ms, level 0 PSNR %.1f dB\n\n",
+           (unsigned int)(raw->color.size() * 4 / 1024), (unsigned int)(bc1->color.size() * 4 / 1024),
+           encodeTime * 1000.0, psnr(rawAddress, bc1Address));
+
+    std::vector<unsigned int> screen(SCREEN_W * SCREEN_H);
+    const float scales[] = { 0.5f, 1.0f, 2.0f };
+    printf("texels/pixel  tiled KiB/frame  BC1 KiB/frame  tiled Mtexels/s  BC1 Mtexels/s  decodes/frame\n");
+    for(unsigned int i=0; i<sizeof(scales)/sizeof(scales[0]); ++i){
+        Mapping mapping(scales[i]);
+        double samples = (double)FRAMES * SCREEN_W * SCREEN_H;
+        double rawTime = sampleFrames<TEXTURE_TILED>(rawAddress, mapping, screen);
+        unsigned long long decodes = ThreadBC1Cache().decodes;
+        double bc1Time = sampleFrames<TEXTURE_BC1>(bc1Address, mapping, screen);
+        decodes = ThreadBC1Cache().decodes - decodes;
+        printf("%12.1f  %15u  %13u  %15.0f  %13.0f  %13u\n", scales[i],
+               (unsigned int)(touchedBytes(rawAddress, mapping) / 1024),
+               (unsigned int)(touchedBytes(bc1Address, mapping) / 1024),
+               samples / rawTime / 1e6, samples / bc1Time / 1e6, (unsigned int)(decodes / FRAMES));
+    }
+
+    DeleteTexture(raw);
+    DeleteTexture(bc1);
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <il.h>
+#include <ilu.h>
+#include "texture.h"
+#include "texturefile.h"
+
+/* Converts an image into a texture file for MapTextureFile.
+   The defaults match what the demo samples: tiled, and in the format
+   of the 32-bit screen surface with premultiplied alpha. */
+static void usage()
+{
+    printf("Usage: texconvert [-linear|-bc1] [-rgba] [-straight] <image> <texture file>\n"
+           "  -linear    Store the levels row by row instead of in 4x4 tiles\n"
+           "  -bc1       Compress the 4x4 tiles to BC1 blocks, 4 bits per texel\n"
+           "  -rgba      Keep DevIL's R, G, B, A byte order instead of B, G, R, A\n"
+           "  -straight  Don't premultiply the color by alpha\n");
+}
+
+int main(int argc, char* argv[])
+{
+    TextureLayout layout = TEXTURE_TILED;
+    bool swapped = true, premultiplied = true;
+    const char* files[2] = { NULL, NULL };
+    int fileCount = 0;
+
+    for(int i=1; i<argc; ++i){
+        if(!strcmp(argv[i], "-linear"))
+            layout = TEXTURE_LINEAR;
+        else if(!strcmp(argv[i], "-bc1"))
+            layout = TEXTURE_BC1;
+        else if(!strcmp(argv[i], "-rgba"))
+            swapped = false;
+        else if(!strcmp(argv[i], "-straight"))
+            premultiplied = false;
+        else if(argv[i][0] != '-' && fileCount < 2)
+            files[fileCount++] = argv[i];
+        else {
+            usage();
+            return -1;
+        }
+    }
+    if(fileCount != 2){
+        usage();
+        return -1;
+    }
+
+    ilInit();
+    iluInit();
+    TextureFormat format = (TextureFormat)((swapped ? TEXTURE_FORMAT_SWAPPED : 0) |
+                                           (premultiplied ? TEXTURE_FORMAT_PREMULTIPLIED : 0));
+    /* Converted before compressing, so BC1 is only encoded once */
+    Texture* texture = const_cast<Texture*>(ReadPNG(files[0], TEXTURE_LINEAR, format));
+    if(!texture){
+        printf("Couldn't load %s\n", files[0]);
+        return -1;
+    }
+    SetTextureLayout(*texture, layout);
+    if(!WriteTextureFile(files[1], *texture)){
+        printf("Couldn't write %s\n", files[1]);
+        DeleteTexture(texture);
+        return -1;
+    }
+    printf("%s: %ux%u, %u levels, %u KiB\n", files[1], texture->width, texture->height,
+           (unsigned int)texture->levels.size(), (unsigned int)(texture->color.size() * 4 / 1024));
+    DeleteTexture(texture);
+    return 0;
+}
@@ -1,35 +1,401 @@
 #include "texture.h"
+#include "texturefile.h"
+#include "pngdecode.h"
 #include <vector>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <algorithm>
 #include <IL/il.h>
 #include <IL/ilu.h>
 
-const Texture* currentTexture;
+/* Indexed by handle, NULL in removed slots */
+static std::vector<const Texture*> textureTable;
 
+TextureHandle AddTexture(const Texture* texture)
+{
+    std::vector<const Texture*>::iterator slot = std::find(textureTable.begin(), textureTable.end(),
+                                                           (const Texture*)NULL);
+    if(slot != textureTable.end()){
+        *slot = texture;
+        return slot - textureTable.begin();
+    }
+    textureTable.push_back(texture);
+    return textureTable.size() - 1;
+}
+
+void RemoveTexture(TextureHandle handle)
+{
+    if(handle < textureTable.size())
+        textureTable[handle] = NULL;
+    while(!textureTable.empty() && !textureTable.back())
+        textureTable.pop_back();
+}
+
+void SetTexture(TextureHandle handle, const Texture* texture)
+{
+    if(handle < textureTable.size())
+        textureTable[handle] = texture;
+}
+
+const Texture* GetTexture(TextureHandle handle)
+{
+    return handle < textureTable.size() ? textureTable[handle] : NULL;
+}
+
+unsigned int TextureHandleCount()
+{
+    return textureTable.size();
+}
+
+/* Rounded average of four RGBA texels, one byte channel at a time */
+static unsigned int averageTexels(unsigned int a, unsigned int b, unsigned int c, unsigned int d)
+{
+    unsigned int result = 0;
+    for(int shift=0; shift<32; shift+=8){
+        unsigned int sum = ((a >> shift) & 255) + ((b >> shift) & 255) +
+                           ((c >> shift) & 255) + ((d >> shift) & 255);
+        result |= ((sum + 2) >> 2) << shift;
+    }
+    return result;
+}
+
+/* Alpha is byte 3 in every format, the color bytes are scaled alike */
+static unsigned int premultiplyTexel(unsigned int c)
+{
+    unsigned int alpha = c >> 24;
+    unsigned int result = c & 0xFF000000;
+    for(int shift=0; shift<24; shift+=8)
+        result |= ((((c >> shift) & 255) * alpha + 127) / 255) << shift;
+    return result;
+}
+
+static unsigned int unpremultiplyTexel(unsigned int c)
+{
+    unsigned int alpha = c >> 24;
+    if(!alpha)
+        return 0;
+    unsigned int result = c & 0xFF000000;
+    for(int shift=0; shift<24; shift+=8)
+        result |= std::min(((((c >> shift) & 255) * 255 + alpha/2) / alpha), 255u) << shift;
+    return result;
+}
+
+static bool isPow2(unsigned int n)
+{
+    return n && !(n & (n - 1));
+}
+
+static int log2Pow2(unsigned int n)
+{
+    int shift = 0;
+    while((1u << shift) < n)
+        ++shift;
+    return shift;
+}
+
+/* Words a level takes up in a layout, with its pitch set to match */
+static unsigned int levelSize(TextureLevel& level, TextureLayout layout)
+{
+    if(layout == TEXTURE_LINEAR){
+        level.pitch = level.width;
+        return level.width * level.height;
+    }
+    const unsigned int tile = 1u << TEXTURE_TILE_SHIFT;
+    unsigned int tilesX = (level.width + tile - 1) >> TEXTURE_TILE_SHIFT;
+    unsigned int tilesY = (level.height + tile - 1) >> TEXTURE_TILE_SHIFT;
+    level.pitch = tilesX * tile * tile;
+    if(layout == TEXTURE_BC1)
+        return tilesX * tilesY * 2;
+    return level.pitch * tilesY;
+}
+
+static TexelAddress levelAddress(const TextureLevel& l, TextureLayout layout, const unsigned int* texels)
+{
+    TexelAddress address;
+    address.texels = texels;
+    address.maxS = l.width - 1;
+    address.maxT = l.height - 1;
+    address.pow2 = isPow2(l.width) && isPow2(l.height);
+    address.shiftS = log2Pow2(l.width);
+    address.shiftT = log2Pow2(l.height);
+    address.pitch = l.pitch;
+    address.pitchShift = log2Pow2(l.pitch);
+    address.tiled = layout != TEXTURE_LINEAR;
+    address.layout = layout;
+    return address;
+}
 
-void BindTexture(const Texture* texture)
+TexelAddress GetTexelAddress(const Texture& texture, unsigned int level)
 {
-    currentTexture = texture;
+    return levelAddress(texture.levels[level], texture.layout, texture.texels(level));
 }
 
+void SetTextureLayout(Texture& texture, TextureLayout layout)
+{
+    if(layout == texture.layout)
+        return;
+
+    TexelVector color;
+    std::vector<TextureLevel> levels(texture.levels);
+    unsigned int offset = 0;
+    for(size_t i=0; i<levels.size(); ++i){
+        levels[i].offset = offset;
+        offset += levelSize(levels[i], layout);
+    }
+    color.resize(offset, 0);
+
+    for(unsigned int i=0; i<levels.size(); ++i){
+        TexelAddress src = GetTexelAddress(texture, i);
+        unsigned int* dstTexels = &color[levels[i].offset];
+        TexelAddress dst = levelAddress(levels[i], layout, dstTexels);
+        if(layout == TEXTURE_BC1){
+            /* Tiles are encoded in order. Texels past the edge repeat the
+               last row and column, src.fetch clamps to it. */
+            unsigned int* block = dstTexels;
+            for(int t=0; t<=src.maxT; t+=4){
+                for(int s=0; s<=src.maxS; s+=4){
+                    unsigned int tile[16];
+                    for(int j=0; j<16; ++j)
+                        tile[j] = src.fetch(s + (j & 3), t + (j >> 2));
+                    unsigned long long bits = EncodeBC1Block(tile);
+                    memcpy(block, &bits, sizeof(bits));
+                    block += 2;
+                }
+            }
+            continue;
+        }
+        for(int t=0; t<=src.maxT; ++t)
+            for(int s=0; s<=src.maxS; ++s)
+                dstTexels[dst.index(s, t)] = src.fetch(s, t);
+    }
+
+    texture.color.swap(color);
+    texture.levels.swap(levels);
+    texture.layout = layout;
+}
 
-const struct Texture* ReadPNG(const std::string& name)
+/* ConvertTexels for 'count' words of a level in 'layout'. Decoded BC1
+   texels are opaque or transparent black, which read the same
+   premultiplied, so only the byte order can change. It is swapped in
+   the blocks, without decoding them. */
+static void convertWords(unsigned int* dst, const unsigned int* src, size_t count,
+                         TextureLayout layout, TextureFormat from, TextureFormat to)
 {
-    Texture *texture;
+    if(layout != TEXTURE_BC1){
+        ConvertTexels(dst, src, count, from, to);
+        return;
+    }
+    if(!((to ^ from) & TEXTURE_FORMAT_SWAPPED)){
+        if(dst != src)
+            memcpy(dst, src, count * sizeof(unsigned int));
+        return;
+    }
+    for(size_t i=0; i+1<count; i+=2){
+        unsigned long long block;
+        memcpy(&block, &src[i], sizeof(block));
+        block = SwapBC1BlockRB(block);
+        memcpy(&dst[i], &block, sizeof(block));
+    }
+}
+
+void SetTextureFormat(Texture& texture, TextureFormat format)
+{
+    if(format == texture.format)
+        return;
+    if(!texture.color.empty())
+        convertWords(&texture.color[0], &texture.color[0], texture.color.size(),
+                     texture.layout, texture.format, format);
+    for(size_t i=0; i<texture.levelColor.size(); ++i)
+        convertWords(&texture.levelColor[i][0], &texture.levelColor[i][0], texture.levelColor[i].size(),
+                     texture.layout, texture.format, format);
+    texture.format = format;
+}
+
+void ConvertTexels(unsigned int* dst, const unsigned int* src, size_t count,
+                   TextureFormat from, TextureFormat to)
+{
+    bool swap = (to ^ from) & TEXTURE_FORMAT_SWAPPED;
+    bool premultiply = (to & ~from) & TEXTURE_FORMAT_PREMULTIPLIED;
+    bool unpremultiply = (~to & from) & TEXTURE_FORMAT_PREMULTIPLIED;
+    if(!premultiply && !unpremultiply){
+        /* The common cases, kept simple enough to vectorize */
+        if(!swap){
+            if(dst != src)
+                memcpy(dst, src, count * sizeof(unsigned int));
+            return;
+        }
+        for(size_t i=0; i<count; ++i){
+            unsigned int c = src[i];
+            dst[i] = (c & 0xFF00FF00) | ((c >> 16) & 0xFF) | ((c & 0xFF) << 16);
+        }
+        return;
+    }
+    for(size_t i=0; i<count; ++i){
+        unsigned int c = src[i];
+        if(unpremultiply)
+            c = unpremultiplyTexel(c);
+        if(swap)
+            c = (c & 0xFF00FF00) | ((c >> 16) & 0xFF) | ((c & 0xFF) << 16);
+        if(premultiply)
+            c = premultiplyTexel(c);
+        dst[i] = c;
+    }
+}
+
+Texture* CopyTextureLevels(const Texture& texture, unsigned int firstLevel)
+{
+    Texture* copy = new Texture;
+    copy->width = texture.levels[firstLevel].width;
+    copy->height = texture.levels[firstLevel].height;
+    copy->layout = texture.layout;
+    copy->format = texture.format;
+    copy->firstLevel = texture.firstLevel + firstLevel;
+    for(unsigned int i=firstLevel; i<texture.levels.size(); ++i){
+        TextureLevel level = texture.levels[i];
+        const unsigned int* texels = texture.texels(i);
+        unsigned int words = levelSize(level, texture.layout);
+        level.offset = copy->color.size();
+        copy->color.insert(copy->color.end(), texels, texels + words);
+        copy->levels.push_back(level);
+    }
+    return copy;
+}
+
+void PushTextureLevel(Texture& texture, const Texture& source, unsigned int level)
+{
+    TextureLevel l = source.levels[level];
+    unsigned int words = levelSize(l, source.layout);
+    TexelVector texels(words);
+    convertWords(&texels[0], source.texels(level), words, source.layout, source.format, texture.format);
+    l.offset = 0;
+    texture.levelColor.insert(texture.levelColor.begin(), TexelVector());
+    texture.levelColor[0].swap(texels);
+    texture.levels.insert(texture.levels.begin(), l);
+    texture.width = l.width;
+    texture.height = l.height;
+    texture.layout = source.layout;
+    texture.firstLevel = source.firstLevel + level;
+}
+
+void PopTextureLevel(Texture& texture)
+{
+    texture.levelColor.erase(texture.levelColor.begin());
+    texture.levels.erase(texture.levels.begin());
+    texture.width = texture.levels[0].width;
+    texture.height = texture.levels[0].height;
+    ++texture.firstLevel;
+}
+
+size_t TextureLevelBytes(const Texture& texture, unsigned int level)
+{
+    TextureLevel l = texture.levels[level];
+    return levelSize(l, texture.layout) * sizeof(unsigned int);
+}
+
+void DeleteTexture(const Texture* texture)
+{
+    if(!texture)
+        return;
+    UnmapTextureFile(texture->file);
+    delete texture;
+}
+
+void BuildMipChain(Texture& texture)
+{
+    TextureLevel level = { 0, texture.width, texture.height, texture.width };
+    texture.levels.assign(1, level);
+    texture.layout = TEXTURE_LINEAR;
+    texture.color.resize(texture.width * texture.height);
+
+    while(level.width > 1 || level.height > 1){
+        TextureLevel next;
+        next.offset = level.offset + level.width * level.height;
+        next.width = std::max(level.width / 2, 1u);
+        next.height = std::max(level.height / 2, 1u);
+        next.pitch = next.width;
+        texture.color.resize(next.offset + next.width * next.height);
+
+        const unsigned int* src = &texture.color[level.offset];
+        unsigned int* dst = &texture.color[next.offset];
+        for(unsigned int y=0; y<next.height; ++y){
+            unsigned int y0 = std::min(y*2, level.height - 1);
+            unsigned int y1 = std::min(y*2 + 1, level.height - 1);
+            for(unsigned int x=0; x<next.width; ++x){
+                unsigned int x0 = std::min(x*2, level.width - 1);
+                unsigned int x1 = std::min(x*2 + 1, level.width - 1);
+                dst[x + y*next.width] = averageTexels(src[x0 + y0*level.width], src[x1 + y0*level.width],
+                                                      src[x0 + y1*level.width], src[x1 + y1*level.width]);
+            }
+        }
+        texture.levels.push_back(next);
+        level = next;
+    }
+}
+
+/* DevIL decodes into one global bound image, so only one thread at a time
+   may use it */
+static std::mutex devilMutex;
+
+/* Level 0 of 'texture' from the images DecodePNG leaves out, in the byte
+   order of 'format' */
+static bool decodeWithDevIL(const std::vector<unsigned char>& data, Texture& texture, TextureFormat format)
+{
+    std::lock_guard<std::mutex> lock(devilMutex);
     ILuint img;
     ilGenImages(1, &img);
     ilBindImage(img);
-    if(!ilLoadImage(name.c_str())){
-        return nullptr;
+    if(!ilLoadL(IL_TYPE_UNKNOWN, &data[0], data.size())){
+        ilDeleteImages(1, &img);
+        return false;
     }
     iluFlipImage();
 
-    texture = new Texture;
-    texture->width = ilGetInteger(IL_IMAGE_WIDTH);
-    texture->height = ilGetInteger(IL_IMAGE_HEIGHT);
-    texture->color.resize(texture->width * texture->height);
-    ilCopyPixels(0, 0, 0, texture->width, texture->height, 1, IL_RGBA, IL_UNSIGNED_BYTE, &texture->color[0]);
+    texture.width = ilGetInteger(IL_IMAGE_WIDTH);
+    texture.height = ilGetInteger(IL_IMAGE_HEIGHT);
+    texture.color.resize(texture.width * texture.height);
+    /* DevIL swaps the channels as it copies, which leaves at most the
+       premultiplication to do */
+    bool swapped = format & TEXTURE_FORMAT_SWAPPED;
+    ilCopyPixels(0, 0, 0, texture.width, texture.height, 1, swapped ? IL_BGRA : IL_RGBA,
+                 IL_UNSIGNED_BYTE, &texture.color[0]);
+    texture.format = swapped ? TEXTURE_BGRA8 : TEXTURE_RGBA8;
     ilDeleteImages(1, &img);
+    return true;
+}
 
-    return texture;
+static bool readFile(const std::string& name, std::vector<unsigned char>& data)
+{
+    FILE* in = fopen(name.c_str(), "rb");
+    if(!in)
+        return false;
+    bool ok = fseek(in, 0, SEEK_END) == 0;
+    long size = ok ? ftell(in) : -1;
+    ok = size > 0 && fseek(in, 0, SEEK_SET) == 0;
+    if(ok){
+        data.resize(size);
+        ok = fread(&data[0], 1, data.size(), in) == data.size();
+    }
+    fclose(in);
+    return ok;
 }
 
+const struct Texture* ReadPNG(const std::string& name, TextureLayout layout, TextureFormat format)
+{
+    /* PNGs are decoded right here, in parallel with other loads. Only
+       the other images DevIL reads take turns on its lock. */
+    std::vector<unsigned char> data;
+    if(!readFile(name, data))
+        return nullptr;
+
+    Texture *texture = new Texture;
+    if(!DecodePNG(&data[0], data.size(), *texture) && !decodeWithDevIL(data, *texture, format)){
+        delete texture;
+        return nullptr;
+    }
+    SetTextureFormat(*texture, format);
+    BuildMipChain(*texture);
+    SetTextureLayout(*texture, layout);
+
+    return texture;
+}
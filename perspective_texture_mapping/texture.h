@@ -11,20 +11,244 @@ Neither the name of the organization nor the names of its contributors may be us
 
 #ifndef TEXTURE_H_GUARD
 #define TEXTURE_H_GUARD
+#include <cstddef>
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <texfilter.h>
+#include "bc1.h"
+#include "bufferalloc.h"
+
+/* How the texels of each level are ordered in memory */
+enum TextureLayout
+{
+    TEXTURE_LINEAR=0, /* Row by row */
+    TEXTURE_TILED,    /* 4x4 texel tiles of 64 bytes, a cache line each, row by row */
+    TEXTURE_BC1       /* The tiles of TEXTURE_TILED as 8-byte BC1 blocks, decoded
+                         into a per-thread cache when they are first sampled */
+};
+
+/* Byte order of the 32-bit texels, and whether the color channels are
+   premultiplied by alpha. Bit 0 is the byte order, bit 1 premultiplication. */
+enum TextureFormat
+{
+    TEXTURE_RGBA8=0,              /* R, G, B, A, as DevIL hands them out */
+    TEXTURE_BGRA8,                /* B, G, R, A, a 32-bit SDL surface on little endian machines */
+    TEXTURE_RGBA8_PREMULTIPLIED,
+    TEXTURE_BGRA8_PREMULTIPLIED
+};
+
+#define TEXTURE_FORMAT_SWAPPED 1
+#define TEXTURE_FORMAT_PREMULTIPLIED 2
+
+/* log2 of the tile side in TEXTURE_TILED */
+#define TEXTURE_TILE_SHIFT 2
+
+/* One level of the mip chain, stored at 'offset' words into Texture::color.
+   A word is a texel, or half a block in TEXTURE_BC1. */
+struct TextureLevel
+{
+    unsigned int offset;
+    unsigned int width;
+    unsigned int height;
+    unsigned int pitch;  /* Texels from one row (of tiles when tiled) to the next.
+                            Blocks count as their 16 texels. */
+};
+
+struct TextureFile;
+
+/* Texel storage, from the allocator in bufferalloc.h */
+typedef std::vector< unsigned int, BufferAllocator<unsigned int> > TexelVector;
 
 struct Texture
 {
-    std::vector<unsigned int> color;
+    Texture() : mapped(NULL), width(0), height(0), layout(TEXTURE_LINEAR),
+                format(TEXTURE_RGBA8), file(NULL), firstLevel(0) {}
+
+    TexelVector color;                /* Level 0 first, then the smaller levels, in words */
+    std::vector<TexelVector> levelColor; /* Each level in its own allocation, used instead
+                                            of 'color' when not empty, see PushTextureLevel */
+    const unsigned int* mapped;       /* Used instead of 'color' when read from a texture file */
     unsigned int width;
     unsigned int height;
+    std::vector<TextureLevel> levels; /* levels[0] is the full size image */
+    TextureLayout layout;
+    TextureFormat format;
+    TextureFile* file;                /* Mapping that 'mapped' points into */
+    unsigned int firstLevel;          /* Level of the full mip chain that levels[0] is.
+                                         Nonzero when only the small end of the chain
+                                         is resident, see residency.h */
+
+    const unsigned int* texels(unsigned int level) const
+    {
+        if(!levelColor.empty())
+            return &levelColor[level][0];
+        return (mapped ? mapped : &color[0]) + levels[level].offset;
+    }
 };
 
+/* Turns whole texel coordinates into an index for one level, in the
+   texture's layout. Coordinates are clamped to the level. */
+struct TexelAddress
+{
+    const unsigned int* texels;
+    int maxS, maxT;           /* width - 1 and height - 1 */
+    int shiftS, shiftT;       /* log2 of width and height when 'pow2' */
+    int pitchShift;           /* log2 of the pitch when 'pow2' */
+    unsigned int pitch;
+    bool pow2;                /* Both sides are powers of two */
+    bool tiled;               /* Layout is TEXTURE_TILED or TEXTURE_BC1 */
+    TextureLayout layout;
+
+    /* Pow2 and Tiled must match 'pow2' and 'tiled'. As template arguments
+       they let the inner loops use constant shifts and masks, and turn
+       the row multiply into a shift for power of two sizes. */
+    template<bool Pow2, bool Tiled> unsigned int index(int s, int t) const
+    {
+        const int shift = Tiled ? TEXTURE_TILE_SHIFT : 0;
+        const int mask = (1 << shift) - 1;
+        s = std::max(0, std::min(s, maxS));
+        t = std::max(0, std::min(t, maxT));
+        unsigned int row = Pow2 ? (unsigned int)(t >> shift) << pitchShift : (t >> shift) * pitch;
+        return row + ((s >> shift) << (2*shift)) + ((t & mask) << shift) + (s & mask);
+    }
+
+    /* Picks the template arguments at run time */
+    unsigned int index(int s, int t) const
+    {
+        if(tiled)
+            return pow2 ? index<true, true>(s, t) : index<false, true>(s, t);
+        return pow2 ? index<true, false>(s, t) : index<false, false>(s, t);
+    }
+
+    /* The texel at whole texel coordinates. BC1 indexes like the tiled
+       layout, with 16 texels for every two words. */
+    template<bool Pow2, TextureLayout Layout> unsigned int fetch(int s, int t) const
+    {
+        unsigned int i = index<Pow2, Layout != TEXTURE_LINEAR>(s, t);
+        if(Layout == TEXTURE_BC1)
+            return DecodedBC1Block(texels + (i >> 4)*2)[i & 15];
+        return texels[i];
+    }
+
+    unsigned int fetch(int s, int t) const
+    {
+        switch(layout)
+        {
+        case TEXTURE_LINEAR:
+            return pow2 ? fetch<true, TEXTURE_LINEAR>(s, t) : fetch<false, TEXTURE_LINEAR>(s, t);
+        case TEXTURE_TILED:
+            return pow2 ? fetch<true, TEXTURE_TILED>(s, t) : fetch<false, TEXTURE_TILED>(s, t);
+        default:
+            return pow2 ? fetch<true, TEXTURE_BC1>(s, t) : fetch<false, TEXTURE_BC1>(s, t);
+        }
+    }
+
+    /* Bilinear sample at Q16 texel coordinates. The scale to texels maps
+       s = 0 and s = 1 onto the centers of the first and last texel, so
+       the whole texel position is the top-left texel of the 2x2 footprint
+       and the fraction weighs in its neighbours. The neighbours are
+       clamped at the last row and column. */
+    template<bool Pow2, TextureLayout Layout> unsigned int bilinear(int s, int t) const
+    {
+        int s0 = s >> 16, t0 = t >> 16;
+        return BilinearBlend(fetch<Pow2, Layout>(s0, t0), fetch<Pow2, Layout>(s0 + 1, t0),
+                             fetch<Pow2, Layout>(s0, t0 + 1), fetch<Pow2, Layout>(s0 + 1, t0 + 1),
+                             (s >> 8) & 255, (t >> 8) & 255);
+    }
+
+    unsigned int bilinear(int s, int t) const
+    {
+        switch(layout)
+        {
+        case TEXTURE_LINEAR:
+            return pow2 ? bilinear<true, TEXTURE_LINEAR>(s, t) : bilinear<false, TEXTURE_LINEAR>(s, t);
+        case TEXTURE_TILED:
+            return pow2 ? bilinear<true, TEXTURE_TILED>(s, t) : bilinear<false, TEXTURE_TILED>(s, t);
+        default:
+            return pow2 ? bilinear<true, TEXTURE_BC1>(s, t) : bilinear<false, TEXTURE_BC1>(s, t);
+        }
+    }
+
+    /* Nearest or bilinear sample at Q16 texel coordinates */
+    template<bool Pow2, TextureLayout Layout, bool Bilinear> unsigned int sample(int s, int t) const
+    {
+        return Bilinear ? bilinear<Pow2, Layout>(s, t) : fetch<Pow2, Layout>(s >> 16, t >> 16);
+    }
+
+    /* Q16 s or t in [0,1] to Q16 texels, v * (width - 1) truncated to
+       32 bits like the rasterizers have always done it */
+    template<bool Pow2> int scaleS(int v) const
+    {
+        return Pow2 ? (int)(((long long)v << shiftS) - v) : (int)((long long)v * maxS);
+    }
+    template<bool Pow2> int scaleT(int v) const
+    {
+        return Pow2 ? (int)(((long long)v << shiftT) - v) : (int)((long long)v * maxT);
+    }
+};
+
+TexelAddress GetTexelAddress(const Texture& texture, unsigned int level);
+
+/* Loads level 0 in 'format' and builds the mip chain from it, then stores
+   it in 'layout'. Alpha is premultiplied before the mip chain is built,
+   so transparent texels don't bleed their color into smaller levels.
+   Safe to call from several threads. PNGs are decoded on the calling
+   thread with DecodePNG, other images with DevIL, which takes turns. */
+const struct Texture* ReadPNG(const std::string& name, TextureLayout layout = TEXTURE_TILED,
+                              TextureFormat format = TEXTURE_RGBA8);
+/* Appends the mip chain to a texture that only has level 0 in 'color',
+   in linear layout. Each side is halved down to 1x1 with a 2x2 box
+   filter. Odd sizes round down, so their last row or column doesn't
+   reach the next level. */
+void BuildMipChain(Texture& texture);
+/* Reorders every level into another layout. Tiled levels are padded to
+   whole tiles, and the padding is never sampled. Changing to TEXTURE_BC1
+   compresses the texture, which is lossy. */
+void SetTextureLayout(Texture& texture, TextureLayout layout);
+/* Swaps the R and B channels of every texel and multiplies or divides
+   the color by alpha as the formats differ. Dividing loses precision,
+   and premultiplying after BuildMipChain filters with straight alpha.
+   BC1 blocks are changed in place, and stay exact. */
+void SetTextureFormat(Texture& texture, TextureFormat format);
+/* The per-texel conversion behind SetTextureFormat, for 'count' texels.
+   dst may be src. */
+void ConvertTexels(unsigned int* dst, const unsigned int* src, size_t count,
+                   TextureFormat from, TextureFormat to);
+/* SetTextureFormat only works on textures that own their texels, not
+   on mapped ones. BuildMipChain and SetTextureLayout also need them in
+   'color'. */
+
+/* A texture that owns a copy of levels firstLevel and up of another */
+Texture* CopyTextureLevels(const Texture& texture, unsigned int firstLevel);
+/* Add and drop the finest level of a texture that keeps its levels in
+   'levelColor', without touching the others. PushTextureLevel copies
+   'level' of 'source' in, converted to the texture's format. The texture
+   must be empty or start at level + 1. */
+void PushTextureLevel(Texture& texture, const Texture& source, unsigned int level);
+void PopTextureLevel(Texture& texture);
+/* Memory taken by the texels of a level */
+size_t TextureLevelBytes(const Texture& texture, unsigned int level);
 
-const struct Texture* ReadPNG(const std::string& name);
-void BindTexture(const Texture* texture);
+/* Frees a texture from ReadPNG, MapTextureFile, CopyTextureLevels, or
+   one that was given its levels with PushTextureLevel */
+void DeleteTexture(const Texture* texture);
 
-extern const struct Texture* currentTexture;
+/* Triangles name their texture by handle, an index into a table of
+   textures. The table is only read while drawing, so textures must be
+   added and removed between DrawTriangle calls. The table doesn't own
+   the textures, remove one before deleting it. Handles of removed
+   textures are given out again by later AddTexture calls. */
+typedef unsigned int TextureHandle;
+#define TEXTURE_HANDLE_NONE 0xFFFFFFFFu
+TextureHandle AddTexture(const Texture* texture);
+void RemoveTexture(TextureHandle handle);
+/* Points a handle at another texture, for instance once the texture it
+   stood in for is loaded */
+void SetTexture(TextureHandle handle, const Texture* texture);
+/* NULL for handles that don't name a texture */
+const Texture* GetTexture(TextureHandle handle);
+/* One past the largest handle in use */
+unsigned int TextureHandleCount();
 
 #endif
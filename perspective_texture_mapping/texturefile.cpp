@@ -0,0 +1,173 @@
+#include "texturefile.h"
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/* A read-only view of a whole file */
+struct TextureFile
+{
+    const unsigned char* data;
+    size_t size;
+#if defined(_WIN32)
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+static TextureFile* mapFile(const std::string& name)
+{
+    TextureFile* file = new TextureFile;
+#if defined(_WIN32)
+    file->file = CreateFileA(name.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                             OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER size;
+    if(file->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file->file, &size) || !size.QuadPart){
+        if(file->file != INVALID_HANDLE_VALUE)
+            CloseHandle(file->file);
+        delete file;
+        return NULL;
+    }
+    file->size = (size_t)size.QuadPart;
+    file->mapping = CreateFileMappingA(file->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    file->data = file->mapping ? (const unsigned char*)MapViewOfFile(file->mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if(!file->data){
+        if(file->mapping)
+            CloseHandle(file->mapping);
+        CloseHandle(file->file);
+        delete file;
+        return NULL;
+    }
+#else
+    int fd = open(name.c_str(), O_RDONLY);
+    struct stat info;
+    if(fd < 0 || fstat(fd, &info) != 0 || info.st_size <= 0){
+        if(fd >= 0)
+            close(fd);
+        delete file;
+        return NULL;
+    }
+    file->size = (size_t)info.st_size;
+    void* data = mmap(NULL, file->size, PROT_READ, MAP_SHARED, fd, 0);
+    /* The mapping keeps the file alive */
+    close(fd);
+    if(data == MAP_FAILED){
+        delete file;
+        return NULL;
+    }
+    file->data = (const unsigned char*)data;
+#endif
+    return file;
+}
+
+void UnmapTextureFile(TextureFile* file)
+{
+    if(!file)
+        return;
+#if defined(_WIN32)
+    UnmapViewOfFile(file->data);
+    CloseHandle(file->mapping);
+    CloseHandle(file->file);
+#else
+    munmap((void*)file->data, file->size);
+#endif
+    delete file;
+}
+
+/* Checks everything the rasterizer trusts. Every level has to lie
+   inside the texel data, with the pitch its layout implies, since
+   TexelAddress turns power of two pitches into shifts. */
+static bool validHeader(const TextureFileHeader& header, const TextureLevel* levels, size_t fileSize)
+{
+    if(header.magic != TEXTURE_FILE_MAGIC || header.version != TEXTURE_FILE_VERSION)
+        return false;
+    if(header.layout > TEXTURE_BC1 || header.format > TEXTURE_BGRA8_PREMULTIPLIED)
+        return false;
+    if(!header.width || !header.height || !header.levelCount || header.levelCount > 32)
+        return false;
+    if(header.texelOffset % TEXTURE_FILE_ALIGNMENT ||
+       header.texelOffset < sizeof(TextureFileHeader) + header.levelCount*sizeof(TextureLevel) ||
+       header.texelOffset > fileSize ||
+       (fileSize - header.texelOffset) / sizeof(unsigned int) < header.texelCount)
+        return false;
+    if(levels[0].width != header.width || levels[0].height != header.height)
+        return false;
+
+    const unsigned int tile = 1u << TEXTURE_TILE_SHIFT;
+    for(unsigned int i=0; i<header.levelCount; ++i){
+        const TextureLevel& l = levels[i];
+        if(!l.width || !l.height || l.width > header.width || l.height > header.height)
+            return false;
+        unsigned long long rows = l.height, rowTexels = l.width, rowWords = l.width;
+        if(header.layout != TEXTURE_LINEAR){
+            unsigned long long tilesX = (l.width + tile - 1) / tile;
+            rows = (l.height + tile - 1) / tile;
+            rowTexels = rowWords = tilesX * tile * tile;
+            if(header.layout == TEXTURE_BC1)
+                rowWords = tilesX * 2;
+        }
+        if(l.pitch != rowTexels || (unsigned long long)l.offset + rowWords * rows > header.texelCount)
+            return false;
+    }
+    return true;
+}
+
+const Texture* MapTextureFile(const std::string& name)
+{
+    TextureFile* file = mapFile(name);
+    if(!file)
+        return NULL;
+
+    const TextureFileHeader* header = (const TextureFileHeader*)file->data;
+    const TextureLevel* levels = (const TextureLevel*)(header + 1);
+    if(file->size < sizeof(TextureFileHeader) ||
+       file->size < sizeof(TextureFileHeader) + std::min<size_t>(header->levelCount, 32)*sizeof(TextureLevel) ||
+       !validHeader(*header, levels, file->size)){
+        UnmapTextureFile(file);
+        return NULL;
+    }
+
+    Texture* texture = new Texture;
+    texture->mapped = (const unsigned int*)(file->data + header->texelOffset);
+    texture->width = header->width;
+    texture->height = header->height;
+    texture->levels.assign(levels, levels + header->levelCount);
+    texture->layout = (TextureLayout)header->layout;
+    texture->format = (TextureFormat)header->format;
+    texture->file = file;
+    return texture;
+}
+
+bool WriteTextureFile(const std::string& name, const Texture& texture)
+{
+    TextureFileHeader header;
+    size_t tableEnd = sizeof(header) + texture.levels.size()*sizeof(TextureLevel);
+    header.magic = TEXTURE_FILE_MAGIC;
+    header.version = TEXTURE_FILE_VERSION;
+    header.width = texture.width;
+    header.height = texture.height;
+    header.layout = texture.layout;
+    header.format = texture.format;
+    header.levelCount = texture.levels.size();
+    header.texelOffset = (tableEnd + TEXTURE_FILE_ALIGNMENT - 1) & ~(TEXTURE_FILE_ALIGNMENT - 1);
+    header.texelCount = texture.color.size();
+    std::vector<unsigned char> padding(header.texelOffset - tableEnd, 0);
+
+    FILE* out = fopen(name.c_str(), "wb");
+    if(!out)
+        return false;
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+        fwrite(&texture.levels[0], sizeof(TextureLevel), texture.levels.size(), out) == texture.levels.size() &&
+        fwrite(padding.data(), 1, padding.size(), out) == padding.size() &&
+        fwrite(&texture.color[0], sizeof(unsigned int), texture.color.size(), out) == texture.color.size();
+    return fclose(out) == 0 && ok;
+}
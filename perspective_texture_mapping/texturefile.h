@@ -0,0 +1,57 @@
+/*
+Copyright (c) 2013, Mads Andreas Elvheim
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+*/
+
+#ifndef TEXTUREFILE_H_GUARD
+#define TEXTUREFILE_H_GUARD
+#include <string>
+#include "texture.h"
+
+/* Texture container for fast startup. It holds a Texture exactly as the
+   rasterizer samples it: flipped, with the whole mip chain, in its final
+   layout and channel order. Loading maps the file and points the texture
+   straight at it, so nothing is decoded or copied, and every process
+   using the same file shares its pages.
+
+   The file is a TextureFileHeader, then one TextureLevel per mip level,
+   then the texels at 'texelOffset'. All fields are 32-bit words in the
+   byte order of the machine that wrote the file. 'texelCount' counts
+   words, so BC1 blocks count twice. */
+
+#define TEXTURE_FILE_MAGIC 0x58544743 /* "CGTX" */
+#define TEXTURE_FILE_VERSION 1
+/* Texel data starts on a multiple of this, so tiles fill cache lines */
+#define TEXTURE_FILE_ALIGNMENT 64
+
+struct TextureFileHeader
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int width;
+    unsigned int height;
+    unsigned int layout;       /* TextureLayout */
+    unsigned int format;       /* TextureFormat */
+    unsigned int levelCount;
+    unsigned int texelOffset;  /* Bytes from the start of the file */
+    unsigned int texelCount;
+};
+
+/* Writes a texture that owns its texels. Returns false on I/O errors. */
+bool WriteTextureFile(const std::string& name, const Texture& texture);
+
+/* Maps a texture file read-only. Returns NULL if the file can't be
+   opened or isn't a valid texture file for this machine. Free the
+   texture with DeleteTexture, which also unmaps the file. */
+const Texture* MapTextureFile(const std::string& name);
+
+/* Called by DeleteTexture */
+void UnmapTextureFile(TextureFile* file);
+
+#endif
@@ -0,0 +1,104 @@
+#include "textureloader.h"
+#include "texturefile.h"
+#include <cstdio>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <threadpool.h>
+
+struct StreamedTexture
+{
+    std::string name;
+    TextureHandle handle;
+    std::future<const Texture*> texture;
+};
+
+static std::unique_ptr<ThreadPool> loaderPool;
+static std::vector<StreamedTexture> streamedTextures;
+
+void SetTextureLoaderThreads(unsigned int count)
+{
+    /* The pool runs its queue dry before the threads exit */
+    loaderPool.reset();
+    loaderPool.reset(new ThreadPool(count));
+}
+
+static const Texture* loadTexture(const std::string& name, TextureFormat format, TextureLayout layout)
+{
+    /* The file header is checked before anything is trusted, so other
+       images are rejected right away */
+    const Texture* texture = MapTextureFile(name);
+    if(!texture)
+        return ReadPNG(name, layout, format);
+    if(texture->format != format){
+        /* Mapped texels are read-only */
+        Texture* copy = CopyTextureLevels(*texture, 0);
+        DeleteTexture(texture);
+        SetTextureFormat(*copy, format);
+        texture = copy;
+    }
+    return texture;
+}
+
+std::future<const Texture*> LoadTextureAsync(const std::string& name, TextureFormat format,
+                                             TextureLayout layout)
+{
+    if(!loaderPool)
+        SetTextureLoaderThreads(std::thread::hardware_concurrency());
+
+    /* ThreadPool jobs are copied, so the promise is shared rather than moved in */
+    std::shared_ptr< std::promise<const Texture*> > promise(new std::promise<const Texture*>);
+    loaderPool->enqueue([promise, name, format, layout]()
+    {
+        promise->set_value(loadTexture(name, format, layout));
+    });
+    return promise->get_future();
+}
+
+TextureHandle StreamTexture(const std::string& name, TextureFormat format, TextureLayout layout)
+{
+    StreamedTexture streamed;
+    streamed.name = name;
+    streamed.handle = AddTexture(PlaceholderTexture());
+    streamed.texture = LoadTextureAsync(name, format, layout);
+    streamedTextures.push_back(std::move(streamed));
+    return streamedTextures.back().handle;
+}
+
+unsigned int UpdateStreamedTextures()
+{
+    for(size_t i=0; i<streamedTextures.size(); ){
+        StreamedTexture& streamed = streamedTextures[i];
+        if(streamed.texture.wait_for(std::chrono::seconds(0)) != std::future_status::ready){
+            ++i;
+            continue;
+        }
+        const Texture* texture = streamed.texture.get();
+        if(texture)
+            SetTexture(streamed.handle, texture);
+        else
+            printf("Couldn't load %s\n", streamed.name.c_str());
+        streamedTextures.erase(streamedTextures.begin() + i);
+    }
+    return streamedTextures.size();
+}
+
+/* Grey and opaque, so it reads the same in every format */
+static const Texture* makePlaceholder()
+{
+    Texture* texture = new Texture;
+    texture->width = texture->height = 8;
+    texture->color.resize(64);
+    for(unsigned int i=0; i<64; ++i)
+        texture->color[i] = ((i ^ (i >> 3)) & 1) ? 0xFF808080 : 0xFFC0C0C0;
+    BuildMipChain(*texture);
+    SetTextureLayout(*texture, TEXTURE_TILED);
+    return texture;
+}
+
+const Texture* PlaceholderTexture()
+{
+    static const Texture* placeholder = makePlaceholder();
+    return placeholder;
+}
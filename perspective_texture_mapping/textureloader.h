@@ -0,0 +1,47 @@
+/*
+Copyright (c) 2013, Mads Andreas Elvheim
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+*/
+
+
+#ifndef TEXTURELOADER_H_GUARD
+#define TEXTURELOADER_H_GUARD
+#include <string>
+#include <future>
+#include "texture.h"
+
+/* Loads textures on a pool of worker threads, in the given format.
+   Texture files from texconvert are mapped, and only copied when they
+   need converting to another format. Anything else is loaded with
+   ReadPNG in the given layout. Each worker decodes PNGs by itself, so
+   they load in parallel, while other images take turns in DevIL. */
+
+/* Number of loader threads, the number of cores by default. Loads that
+   were already started finish first. */
+void SetTextureLoaderThreads(unsigned int count);
+
+/* Starts loading a texture. The future gives NULL if it couldn't be loaded. */
+std::future<const Texture*> LoadTextureAsync(const std::string& name, TextureFormat format,
+                                             TextureLayout layout = TEXTURE_TILED);
+
+/* Starts loading a texture and returns a handle to draw it with right
+   away. The handle names PlaceholderTexture() until the texture is in,
+   and keeps doing so if it can't be loaded. */
+TextureHandle StreamTexture(const std::string& name, TextureFormat format,
+                            TextureLayout layout = TEXTURE_TILED);
+
+/* Points the handles of streamed textures that finished loading at them.
+   Call it between frames, from the thread that draws, since the texture
+   table can't change during DrawTriangle. Returns how many are still loading. */
+unsigned int UpdateStreamedTextures();
+
+/* Small grey checkerboard that stands in for textures being loaded */
+const Texture* PlaceholderTexture();
+
+#endif
@@ -47,3 +47,12 @@ void makeMeshSphere(std::vector<Vector4f>& dst, float radius)
         }
     }
 }
+
+/* The indexed versions generate the triangle list as above and merge
+   the corners it repeats */
+void makeMeshSphere(IndexedMesh& mesh, float radius)
+{
+    std::vector<Vector4f> vertexData, tcoordData;
+    makeMeshSphere(vertexData, radius);
+    buildIndexedMesh(vertexData, tcoordData, mesh);
+}
@@ -1,7 +1,9 @@
-#include <SDL/SDL.h>
 #include <vector>
+#include <cstring>
 #include <algorithm>
 #include <linealg.h>
+#include <vertexstream.h>
+#include <display.h>
 #include "clipplane.h"
 #include "rasterizer.h"
 #include "meshgen.h"
@@ -9,21 +11,19 @@
 
 int main(int argc, char* argv[])
 {
-    (void)argc;
-    (void)argv;
-	
-    const int width = 640;
-    const int height = 480;
-    const int depth = 32;
-    bool running = true;
-    SDL_Event event;
+    DisplayOptions options(640, 480);
+    if(!ParseDisplayOptions(argc, argv, options))
+        return 1;
+    const int width = options.width;
+    const int height = options.height;
     std::vector<Vector4f> triangleMesh;
+    IndexedMesh mesh;
+    VertexStream meshStream;
+    VertexStream clipStream;
     std::vector<Vector4f> workingCopy;   
     std::vector<Vector4i> finalCopy;
 
-    SDL_Init(SDL_INIT_VIDEO);
-    SDL_Surface* screen = SDL_SetVideoMode(width, height, depth, SDL_DOUBLEBUF | SDL_SWSURFACE);
-    SDL_WM_SetCaption("MechCore.net Projection Example", NULL);
+    Display* display = OpenDisplay(options, "MechCore.net Rasterizer Example");
     
     makeMeshCircle(triangleMesh, 2.0f);
     /*
@@ -39,25 +39,17 @@ int main(int argc, char* argv[])
     triangleMesh.push_back(Vector4f( -0.5f,   0.5f, 0.0f, 1.0f));
     triangleMesh.push_back(Vector4f( -0.5f,  -0.5f, 0.0f, 1.0f));
     */
-    while(running){
-        while(SDL_PollEvent(&event)){
-            switch(event.type)
-            {
-            case SDL_KEYDOWN:
-		if(event.key.keysym.sym == SDLK_ESCAPE){
-		    running = false;
-		}
-		break;
-            case SDL_QUIT:
-                running = false;
-                break;
-            }
+    /* Shared corners are only transformed once */
+    buildIndexedMesh(triangleMesh, std::vector<Vector4f>(), mesh);
+    toVertexStream(mesh.vertices, meshStream);
+    while(display->running()){
+        int key;
+        while((key = display->pollKey()) != DISPLAY_KEY_NONE){
+            if(key == DISPLAY_KEY_ESCAPE)
+                display->close();
         }
 
-        float time = (float)SDL_GetTicks() * 0.001f;
-        /* We need a new working copy every frame */
-        workingCopy.resize(triangleMesh.size());
-        std::copy(triangleMesh.begin(), triangleMesh.end(), workingCopy.begin());
+        float time = (float)display->ticks() * 0.001f;
        
         /* world matrix transform */
         Matrix4f worldMatrix = translate(Vector4f(0.0f, 0.0f, -3.25f, 1.0f)) * rotateZ(11.175f * time);
@@ -68,20 +60,12 @@ int main(int argc, char* argv[])
 	rotateZ(time * 22.5f);
 	*/
 	/* perspective function is in linealg.h under /include */
-        Matrix4f clipMatrix = perspective(90.0f, 4.0f/3.0f, 0.01f, 20.0f);
+        Matrix4f clipMatrix = perspective(90.0f, (float)width/height, 0.01f, 20.0f);
 	Matrix4f worldClipMatrix = clipMatrix * worldMatrix;
 				
-        /* Transform our points */
-
-        for(unsigned int i=0; i<workingCopy.size(); i+=3){
-	    Vector4f& p1 = workingCopy[i];
-	    Vector4f& p2 = workingCopy[i+1];
-	    Vector4f& p3 = workingCopy[i+2];
-
-            p1 = worldClipMatrix * p1;
-	    p2 = worldClipMatrix * p2;
-	    p3 = worldClipMatrix * p3;
-	}
+        /* Transform our unique points, several at a time, and expand the triangles for the clipper */
+        transformStream(worldClipMatrix, meshStream, clipStream);
+        gatherTriangles(clipStream, mesh, workingCopy);
 
 	clip_triangle(workingCopy, Vector4f(-1.0f,  0.0f, 0.0f, 1.0f));
 	clip_triangle(workingCopy, Vector4f( 1.0f,  0.0f, 0.0f, 1.0f));
@@ -109,18 +93,17 @@ int main(int argc, char* argv[])
 				    );
 	}
 
-        //SDL_LockSurface(screen);
-        unsigned int* pixels = static_cast<unsigned int*>(screen->pixels);
+        unsigned int pitch;
+        unsigned int* pixels = display->lock(pitch);
 
         /* clear the screen to black */
-        memset(pixels, 0, sizeof(Uint32) * width * height);
+        memset(pixels, 0, sizeof(unsigned int) * pitch * height);
 	/* draw the triangles */
 	TriangleSplit(finalCopy);
-	DrawTriangle(finalCopy, pixels, width, height);
+	DrawTriangle(finalCopy, pixels, pitch, height);
 
-	SDL_Flip(screen);
-        //SDL_UnlockSurface(screen);
+        display->present();
     }    
-    SDL_Quit();
+    delete display;
     return 0;
 }
@@ -70,3 +70,19 @@ void makeMeshCircle(std::vector<Vector4f>& dst, float radius)
 	dst.push_back(v1);
     }
 }
+
+/* The indexed versions generate the triangle list as above and merge
+   the corners it repeats */
+void makeMeshSphere(IndexedMesh& mesh, float radius)
+{
+    std::vector<Vector4f> vertexData, tcoordData;
+    makeMeshSphere(vertexData, radius);
+    buildIndexedMesh(vertexData, tcoordData, mesh);
+}
+
+void makeMeshCircle(IndexedMesh& mesh, float radius)
+{
+    std::vector<Vector4f> vertexData, tcoordData;
+    makeMeshCircle(vertexData, radius);
+    buildIndexedMesh(vertexData, tcoordData, mesh);
+}
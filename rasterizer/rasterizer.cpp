@@ -1,6 +1,5 @@
 #include <vector>
 #include <cstdio>
-#include <SDL/SDL.h>
 #include <linealg.h>
 #include <fixedpoint.h>
 #include "myassert.h"
@@ -73,7 +72,7 @@ static void TriangleScan(
 		  int slope0,
 		  int slope1,
 		  unsigned int* buffer,
-		  unsigned int width,
+		  unsigned int pitch,
 		  unsigned int height,
 		  unsigned int color
 		  )
@@ -92,7 +91,7 @@ static void TriangleScan(
 	//TCoord SlopeTex;
 	int xError = PosX - ceilfp(x0);
 	int xDelta = x1 - x0;
-	int column = y0*width;
+	int column = y0*pitch;
                                 
 	PosX >>= 16;
 	EndX >>= 16;
@@ -111,7 +110,7 @@ static void TriangleScan(
 void DrawTriangle(
 		  std::vector<Vector4i>& vertexData,
 		  unsigned int* buffer,
-		  unsigned int width,
+		  unsigned int pitch,
 		  unsigned int height
 		  )
 {
@@ -186,7 +185,7 @@ void DrawTriangle(
         y1 >>= 16;
 	Vector2i start(x0, y0);
 	Vector2i end(x1, y1);
-	TriangleScan(start, end, slope0, slope1, buffer, width, height, 0xFFFFFFFF);
+	TriangleScan(start, end, slope0, slope1, buffer, pitch, height, 0xFFFFFFFF);
     }
 }
 
@@ -260,5 +259,5 @@ void DrawTriangle(
  
 	end = Vector2i(v1->x * 65536.0f, v2->y);
 	
-	TriangleScan(start, end, slope1, slope0, buffer, width, height, color);
+	TriangleScan(start, end, slope1, slope0, buffer, pitch, height, color);
 */
@@ -16,7 +16,7 @@ Neither the name of the organization nor the names of its contributors may be us
 void DrawTriangle(
 		  std::vector<Vector4i>& vertexData,
 		  unsigned int* buffer,
-		  unsigned int width,
+		  unsigned int pitch,   /* Pixels from one row to the next */
 		  unsigned int height
 		  );
 void TriangleSplit(std::vector<Vector4i>& triangle);